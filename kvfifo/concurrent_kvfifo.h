@@ -0,0 +1,269 @@
+#ifndef CONCURRENT_KVFIFO_H
+#define CONCURRENT_KVFIFO_H
+
+#include "kvfifo.h"
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Queue of kvfifo that may be used by many threads at once: push() from many
+// producers, pop() and pop(k) from many consumers. Every method is
+// linearizable; elements are taken in FIFO order, and so are elements with
+// the same key.
+//
+// Elements are entries of a global list with separate locks for its head
+// and its tail (Michael and Scott's two-lock queue), so producers and
+// consumers of the whole queue do not block each other. Entries of every key
+// are also kept, in the same order, in one of SHARDS shards, each with its
+// own lock, so pop(k) locks only the shard of k.
+//
+// An element is taken by whoever sets its taken flag first. Entries taken
+// through one of the structures are left in the other one and skipped; the
+// list drops them when its head passes them and a shard when they get to the
+// front of their key.
+//
+// Every element is put into both structures, which costs about a third of
+// the throughput of a kvfifo behind one mutex when all threads share one
+// core. The separate locks pay off only when producers and consumers run on
+// separate cores.
+//
+// Elements are returned by value, as references could not outlive a
+// concurrent pop, so K and V must be movable without throwing.
+template <typename K, typename V>
+requires hashable_key<K> && std::semiregular<K> &&
+         std::is_nothrow_move_constructible_v<K> &&
+         std::is_nothrow_move_constructible_v<V>
+class concurrent_kvfifo
+{
+  public:
+    static constexpr std::size_t SHARDS = 64;
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    concurrent_kvfifo() : head(new entry()), tail(head)
+    {}
+
+    concurrent_kvfifo(concurrent_kvfifo const &) = delete;
+    concurrent_kvfifo &operator=(concurrent_kvfifo const &) = delete;
+
+    // Must not run concurrently with any other method
+    ~concurrent_kvfifo()
+    {
+        for (shard &s : shards)
+            for (auto const &[k, queued] : s.entries.items())
+                release(queued);
+
+        for (entry *queued = head; queued;)
+        {
+            entry *next = queued->next.load(std::memory_order_relaxed);
+            release(queued);
+            queued = next;
+        }
+    }
+
+    void push(K const &k, V const &v)
+    requires std::copy_constructible<V>
+    {
+        publish(k, std::make_unique<entry>(k, v));
+    }
+
+    void push(K const &k, V &&v)
+    {
+        publish(k, std::make_unique<entry>(k, std::move(v)));
+    }
+
+    // Removes the first element and returns it, or nullopt if the queue is
+    // empty
+    std::optional<std::pair<K, V>> try_pop()
+    {
+        std::optional<std::pair<K, V>> popped;
+        {
+            std::lock_guard lock(head_mutex);
+
+            // Entries before the first one not taken yet are dropped, and
+            // the entry taken here becomes the dummy head of the list
+            entry *last = head;
+            for (entry *next; (next = last->next.load(std::memory_order_acquire));)
+            {
+                last = next;
+                if (take(*next))
+                {
+                    popped.emplace(std::move(*next->item));
+                    break;
+                }
+            }
+
+            while (head != last)
+            {
+                entry *dropped = head;
+                head = head->next.load(std::memory_order_relaxed);
+                release(dropped);
+            }
+        }
+
+        if (popped)
+            drop_taken(popped->first);
+        return popped;
+    }
+
+    // Removes the first element with key k and returns its value, or
+    // nullopt if there is no such element
+    std::optional<V> try_pop(K const &k)
+    {
+        shard &s = shard_of(k);
+        std::lock_guard lock(s.mutex);
+
+        while (s.entries.count(k) != 0)
+        {
+            entry *first = std::as_const(s.entries).first(k).second;
+            if (take(*first))
+            {
+                std::optional<V> popped(std::move(first->item->second));
+                remove_first(s, k);
+                return popped;
+            }
+            s.entries.pop(k);
+            release(first);
+        }
+        return std::nullopt;
+    }
+
+    std::pair<K, V> pop()
+    {
+        auto popped = try_pop();
+        if (!popped)
+            throw std::invalid_argument("Queue is empty");
+        return std::move(*popped);
+    }
+
+    V pop(K const &k)
+    {
+        auto popped = try_pop(k);
+        if (!popped)
+            throw std::invalid_argument("No element with given key");
+        return std::move(*popped);
+    }
+
+    // Number of elements; while other threads modify the queue, it is the
+    // number at some moment during the call
+    std::size_t size() const noexcept
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+  private:
+    struct entry
+    {
+        // Empty only in the initial dummy head
+        std::optional<std::pair<K, V>> item;
+        std::atomic<entry *> next = nullptr;
+        std::atomic<bool> taken = false;
+        // One for the list and one for the shard
+        std::atomic<std::uint8_t> references = 1;
+
+        entry() = default;
+
+        template <typename VArg>
+        entry(K const &k, VArg &&v)
+            : item(std::in_place, k, std::forward<VArg>(v)), references(2)
+        {}
+    };
+
+    struct alignas(CACHE_LINE) shard
+    {
+        std::mutex mutex;
+        unordered_kvfifo<K, entry *> entries;
+    };
+
+    std::array<shard, SHARDS> shards;
+
+    alignas(CACHE_LINE) std::mutex head_mutex;
+    entry *head;
+
+    alignas(CACHE_LINE) std::mutex tail_mutex;
+    entry *tail;
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> count = 0;
+
+    shard &shard_of(K const &k)
+    {
+        return shards[std::hash<K>{}(k) % SHARDS];
+    }
+
+    // The entry is added to the shard and to the list under the lock of the
+    // shard, so elements of one key are in the same order in both
+    void publish(K const &k, std::unique_ptr<entry> created)
+    {
+        shard &s = shard_of(k);
+        std::lock_guard lock(s.mutex);
+        s.entries.push(k, created.get());
+        count.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard tail_lock(tail_mutex);
+        tail->next.store(created.get(), std::memory_order_release);
+        tail = created.release();
+    }
+
+    bool take(entry &queued) noexcept
+    {
+        if (queued.taken.load(std::memory_order_relaxed) ||
+            queued.taken.exchange(true, std::memory_order_acq_rel))
+            return false;
+
+        count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void release(entry *queued) noexcept
+    {
+        if (queued->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete queued;
+    }
+
+    // Removes the first entry of key k from its shard, which is locked.
+    // Returns false if it can not, because removing needs memory that can
+    // not be allocated; the entry is then dropped by a later call.
+    bool remove_first(shard &s, K const &k) noexcept
+    {
+        entry *first = std::as_const(s.entries).first(k).second;
+        try
+        {
+            s.entries.pop(k);
+        }
+        catch (...)
+        {
+            return false;
+        }
+        release(first);
+        return true;
+    }
+
+    // Drops entries of key k taken through the list from the front of its
+    // shard
+    void drop_taken(K const &k) noexcept
+    {
+        shard &s = shard_of(k);
+        std::lock_guard lock(s.mutex);
+        while (s.entries.count(k) != 0 &&
+               std::as_const(s.entries).first(k).second->taken.load(
+                   std::memory_order_relaxed))
+            if (!remove_first(s, k))
+                break;
+    }
+};
+
+#endif
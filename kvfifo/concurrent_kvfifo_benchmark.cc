@@ -0,0 +1,121 @@
+// Throughput of concurrent_kvfifo, and of kvfifo behind one mutex, for a
+// growing number of producer and consumer threads. Correctness under the
+// same workload is checked by concurrent_kvfifo_test.cc.
+//
+// g++ -std=c++20 -O2 -pthread concurrent_kvfifo_benchmark.cc
+
+#include "concurrent_kvfifo.h"
+#include "kvfifo.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t ELEMENTS = 1 << 20;
+constexpr std::uint32_t KEYS = 1024;
+
+// Value of an element: producer and its number among elements of the
+// producer
+using value_t = std::uint64_t;
+
+value_t value_of(std::size_t producer, std::size_t sequence)
+{
+    return (value_t(producer) << 32) | sequence;
+}
+
+// kvfifo with every call under one mutex, which is what concurrent_kvfifo
+// replaces
+class locked_kvfifo
+{
+  public:
+    void push(std::uint32_t k, value_t v)
+    {
+        std::lock_guard lock(mutex);
+        queue.push(k, v);
+    }
+
+    std::optional<std::pair<std::uint32_t, value_t>> try_pop()
+    {
+        std::lock_guard lock(mutex);
+        if (queue.empty())
+            return std::nullopt;
+        auto front = std::as_const(queue).front();
+        std::pair<std::uint32_t, value_t> popped(front.first, front.second);
+        queue.pop();
+        return popped;
+    }
+
+    std::optional<value_t> try_pop(std::uint32_t k)
+    {
+        std::lock_guard lock(mutex);
+        if (queue.count(k) == 0)
+            return std::nullopt;
+        value_t popped = std::as_const(queue).first(k).second;
+        queue.pop(k);
+        return popped;
+    }
+
+  private:
+    std::mutex mutex;
+    kvfifo<std::uint32_t, value_t> queue;
+};
+
+template <typename queue_t> void benchmark(char const *name, std::size_t threads)
+{
+    queue_t queue;
+    std::size_t const per_producer = ELEMENTS / threads;
+    std::atomic<std::size_t> left = per_producer * threads;
+
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t] {
+            for (std::size_t i = 0; i < per_producer; ++i)
+                queue.push(std::uint32_t((t * 31 + i) % KEYS), value_of(t, i));
+        });
+        workers.emplace_back([&, t] {
+            std::minstd_rand random(t + 1);
+            while (left.load(std::memory_order_relaxed) != 0)
+            {
+                // Every fourth pop is by key
+                if (random() % 4 == 0)
+                {
+                    std::uint32_t const key = random() % KEYS;
+                    if (queue.try_pop(key))
+                        left.fetch_sub(1, std::memory_order_relaxed);
+                }
+                else if (queue.try_pop())
+                    left.fetch_sub(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    printf("%-18s %2zu + %2zu threads  %7.2f Mops/s\n", name, threads, threads,
+           2 * per_producer * threads / elapsed.count() / 1e6);
+}
+} // namespace
+
+int main()
+{
+    printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    for (std::size_t threads : {1, 2, 4, 8})
+    {
+        benchmark<locked_kvfifo>("locked kvfifo", threads);
+        benchmark<concurrent_kvfifo<std::uint32_t, value_t>>("concurrent_kvfifo",
+                                                              threads);
+    }
+}
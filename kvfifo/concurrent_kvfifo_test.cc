@@ -0,0 +1,179 @@
+// Stress test of concurrent_kvfifo: producers push, consumers pop from the
+// front and by key, and afterwards every element has to have been popped
+// exactly once and in an order that a linearizable queue allows. Checks do
+// not depend on NDEBUG.
+//
+// g++ -std=c++20 -O2 -pthread concurrent_kvfifo_test.cc
+// g++ -std=c++20 -O1 -g -pthread -fsanitize=address concurrent_kvfifo_test.cc
+
+#include "concurrent_kvfifo.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t ELEMENTS = 1 << 18;
+constexpr std::uint32_t KEYS = 256;
+
+void check(bool condition, char const *what, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "line %d: %s\n", line, what);
+        exit(1);
+    }
+}
+
+#define CHECK(...) check((__VA_ARGS__), #__VA_ARGS__, __LINE__)
+
+// Value of an element: producer and its number among elements of the
+// producer
+using value_t = std::uint64_t;
+
+value_t value_of(std::size_t producer, std::size_t sequence)
+{
+    return (value_t(producer) << 32) | sequence;
+}
+
+std::uint32_t key_of(std::size_t producer, std::size_t sequence)
+{
+    return std::uint32_t((producer * 31 + sequence) % KEYS);
+}
+
+struct popped_t
+{
+    std::uint32_t key;
+    value_t value;
+    bool by_key;
+};
+
+// Elements of one producer are taken in the order they were pushed by
+// consecutive pop() of one consumer, and so are elements with one key by any
+// pops of one consumer
+void check_popped(std::vector<std::vector<popped_t>> const &popped, std::size_t producers)
+{
+    std::size_t const per_producer = ELEMENTS / producers;
+    std::vector<bool> seen(producers * per_producer);
+    for (auto const &consumer : popped)
+    {
+        std::vector<std::int64_t> last_front(producers, -1);
+        std::vector<std::int64_t> last_key(producers * KEYS, -1);
+        for (auto const &[key, value, by_key] : consumer)
+        {
+            std::size_t const producer = value >> 32;
+            std::int64_t const sequence = value & 0xffffffff;
+            CHECK(producer < producers && std::size_t(sequence) < per_producer);
+            std::size_t const index = producer * per_producer + sequence;
+            CHECK(!seen[index]);
+            seen[index] = true;
+            CHECK(key == key_of(producer, sequence));
+
+            CHECK(last_key[producer * KEYS + key] < sequence);
+            last_key[producer * KEYS + key] = sequence;
+            if (!by_key)
+            {
+                CHECK(last_front[producer] < sequence);
+                last_front[producer] = sequence;
+            }
+        }
+    }
+    for (bool element_seen : seen)
+        CHECK(element_seen);
+}
+
+// One pop in key_ratio is by key
+void stress(std::size_t threads, unsigned key_ratio)
+{
+    concurrent_kvfifo<std::uint32_t, value_t> queue;
+    std::size_t const per_producer = ELEMENTS / threads;
+    std::atomic<std::size_t> left = per_producer * threads;
+    std::vector<std::vector<popped_t>> popped(threads);
+
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t] {
+            for (std::size_t i = 0; i < per_producer; ++i)
+                queue.push(key_of(t, i), value_of(t, i));
+        });
+        workers.emplace_back([&, t] {
+            std::minstd_rand random(t + 1);
+            while (left.load(std::memory_order_relaxed) != 0)
+            {
+                if (random() % key_ratio == 0)
+                {
+                    std::uint32_t const key = random() % KEYS;
+                    if (auto value = queue.try_pop(key))
+                    {
+                        popped[t].push_back({key, *value, true});
+                        left.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                }
+                else if (auto element = queue.try_pop())
+                {
+                    popped[t].push_back({element->first, element->second, false});
+                    left.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+
+    CHECK(queue.empty());
+    CHECK(!queue.try_pop());
+    check_popped(popped, threads);
+}
+
+void test_single_thread()
+{
+    concurrent_kvfifo<int, std::string> queue;
+    CHECK(queue.empty());
+    queue.push(1, "a");
+    queue.push(2, "b");
+    queue.push(1, "c");
+    CHECK(queue.size() == 3);
+
+    CHECK(queue.pop(1) == "a");
+    CHECK(queue.pop() == std::pair<int, std::string>(2, "b"));
+    CHECK(!queue.try_pop(2));
+
+    bool thrown = false;
+    try
+    {
+        queue.pop(2);
+    }
+    catch (std::invalid_argument const &)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    CHECK(queue.pop() == std::pair<int, std::string>(1, "c"));
+    CHECK(queue.empty());
+
+    // Elements left in the queue, and entries taken through one structure
+    // but still in the other, are freed by the destructor
+    queue.push(3, "d");
+    queue.push(3, "e");
+    queue.push(4, "f");
+    CHECK(queue.pop() == std::pair<int, std::string>(3, "d"));
+    CHECK(queue.pop(4) == "f");
+}
+} // namespace
+
+int main()
+{
+    test_single_thread();
+    for (std::size_t threads : {1, 2, 4, 8})
+        for (unsigned key_ratio : {1u, 4u, 1000u})
+            stress(threads, key_ratio);
+}
@@ -1,23 +1,25 @@
 #ifndef KVFIFO_H
 #define KVFIFO_H
 
+#include "kvfifo_arena.h"
+
 #include <concepts>
-#include <list>
-#include <map>
 #include <memory>
+#include <ranges>
+#include <stdexcept>
 #include <utility>
 
 namespace
 {
-template <typename K, typename V> using list_t = std::list<std::pair<K, V>>;
+template <typename K, typename V, typename Index>
+using storage_t = kvfifo_detail::storage<K, V, Index>;
 
 template <typename K, typename V>
-using map_t = std::map<K, std::list<typename list_t<K, V>::iterator>>;
+using map_t = typename storage_t<K, V, kvfifo_ordered>::index_t;
 } // namespace
 
 template <typename K, typename V>
-requires std::totally_ordered<K> && std::semiregular<K>
-    && std::copy_constructible<V> struct k_iterator
+requires std::totally_ordered<K> && std::semiregular<K> struct k_iterator
 {
     using iterator_category = std::bidirectional_iterator_tag;
     using difference_type = std::ptrdiff_t;
@@ -26,7 +28,7 @@ requires std::totally_ordered<K> && std::semiregular<K>
     using reference = K &;
 
     k_iterator() = default;
-    k_iterator(map_t<K, V>::iterator const &initial_iterator)
+    k_iterator(map_t<K, V>::const_iterator const &initial_iterator)
         : map_iterator(initial_iterator)
     {}
     k_iterator(k_iterator<K, V> const &other) : map_iterator(other.map_iterator)
@@ -41,12 +43,12 @@ requires std::totally_ordered<K> && std::semiregular<K>
 
     K const &operator*() const noexcept
     {
-        return map_iterator->first;
+        return map_iterator.key();
     }
 
     k_iterator<K, V> &operator++() noexcept
     {
-        map_iterator++;
+        ++map_iterator;
         return *this;
     }
 
@@ -59,7 +61,7 @@ requires std::totally_ordered<K> && std::semiregular<K>
 
     k_iterator<K, V> &operator--() noexcept
     {
-        map_iterator--;
+        --map_iterator;
         return *this;
     }
 
@@ -73,32 +75,41 @@ requires std::totally_ordered<K> && std::semiregular<K>
     bool operator==(k_iterator<K, V> const &other) const = default;
 
   private:
-    map_t<K, V>::iterator map_iterator;
+    map_t<K, V>::const_iterator map_iterator;
 };
 
-template <typename K, typename V>
-requires std::totally_ordered<K> && std::semiregular<K>
-    && std::copy_constructible<V> class kvfifo
+// Index selects how elements are found by key, see kvfifo_ordered and
+// kvfifo_hashed. V does not have to be copyable; a kvfifo of such values can
+// be moved, but not copied, so it never shares its elements.
+//
+// Elements are linked by 32-bit positions, which keeps nodes small, so one
+// queue holds fewer than 2^32 - 1 (about 4.29e9) elements; pushing more
+// throws std::length_error.
+//
+// As with standard containers, const methods of one kvfifo may be called by
+// many threads at once, and different kvfifo objects by different threads,
+// also when they are copies sharing elements: a modification copies what is
+// shared before changing it, and finds out that it is no longer shared in a
+// way that is ordered after other threads released it.
+template <typename K, typename V, typename Index = kvfifo_ordered>
+requires Index::template accepts<K> && std::semiregular<K>
+    && std::destructible<V> class kvfifo
 {
   public:
-    kvfifo()
-        : elements(std::make_shared<list_t<K, V>>()),
-          elements_by_key(std::make_shared<map_t<K, V>>())
+    kvfifo() : elements(std::make_shared<storage_t<K, V, Index>>())
     {}
 
     kvfifo(kvfifo const &other)
-        : elements(other.elements), elements_by_key(other.elements_by_key)
+    requires std::copy_constructible<V>
+        : elements(other.elements)
     {
         if (other.cannot_share)
-            detach();
+            detach_elements();
     }
 
-    kvfifo(kvfifo &&other) noexcept
-        : elements(std::move(other.elements)),
-          elements_by_key(std::move(other.elements_by_key))
+    kvfifo(kvfifo &&other) noexcept : elements(std::move(other.elements))
     {
-        other.elements = empty_list();
-        other.elements_by_key = empty_map();
+        other.elements = empty_storage();
         other.cannot_share = false;
     }
 
@@ -110,45 +121,82 @@ requires std::totally_ordered<K> && std::semiregular<K>
         return *this;
     }
 
+    // Immutable copy of the queue, which may be passed to other threads and
+    // read by many of them at once while *this is modified. Like the copy
+    // constructor it costs O(1), unless references to elements of *this
+    // given out by non-const methods can still be used to modify them.
+    std::shared_ptr<kvfifo const> snapshot() const
+    requires std::copy_constructible<V>
+    {
+        return std::make_shared<kvfifo const>(*this);
+    }
+
     void push(K const &k, V const &v)
+    requires std::copy_constructible<V>
     {
         throw_exception_if_moved();
 
         try_detach();
 
-        elements->push_back({k, v});
-        try
-        {
-            auto new_element_iter = std::prev(elements->end());
-            auto map_iter = elements_by_key->find(k);
-            if (map_iter == elements_by_key->end())
-                elements_by_key->insert({k, {new_element_iter}});
-            else
-                map_iter->second.push_back(new_element_iter);
-        }
-        catch (...)
-        {
-            elements->pop_back();
-            throw;
-        }
+        elements->push(k, v);
     }
 
-    void pop()
+    void push(K const &k, V &&v)
     {
         throw_exception_if_moved();
 
         try_detach();
 
-        if (elements->empty())
-            throw std::invalid_argument("Queue is empty");
+        elements->push(k, std::move(v));
+    }
+
+    void push(K &&k, V &&v)
+    {
+        throw_exception_if_moved();
+
+        try_detach();
+
+        elements->push(std::move(k), std::move(v));
+    }
+
+    // Adds element with key k and value constructed from args. Like push(),
+    // it either succeeds or leaves the queue unchanged; args are left
+    // unchanged too, unless constructing the value from them can throw.
+    template <typename... Args>
+    requires std::constructible_from<V, Args...>
+    void emplace(K const &k, Args &&...args)
+    {
+        throw_exception_if_moved();
 
-        auto &elements_of_same_key = elements_by_key->find(elements->front().first)->second;
-        elements_of_same_key.pop_front();
+        try_detach();
+
+        elements->push(k, std::forward<Args>(args)...);
+    }
+
+    // Pushes pairs of key and value from the range in order. Elements are
+    // constructed first and the queue is updated once per key, so either all
+    // of them are pushed or the queue is left unchanged.
+    template <std::ranges::input_range R>
+    requires std::constructible_from<std::pair<K, V>, std::ranges::range_reference_t<R>>
+    void push_range(R &&range)
+    {
+        throw_exception_if_moved();
+
+        try_detach();
+
+        elements->push_range(std::forward<R>(range));
+    }
 
-        if (elements_of_same_key.empty())
-            elements_by_key->erase(elements->front().first);
+    void pop()
+    {
+        throw_exception_if_moved();
 
-        elements->pop_front();
+        try_detach();
+
+        if (elements->size == 0)
+            throw std::invalid_argument("Queue is empty");
+
+        elements->pop(std::as_const(*elements).item(elements->head).first);
     }
 
     void pop(K const &k)
@@ -157,16 +205,37 @@ requires std::totally_ordered<K> && std::semiregular<K>
 
         try_detach();
 
-        auto map_iter = elements_by_key->find(k);
-        if (map_iter == elements_by_key->end())
+        if (!elements->pop(k))
             throw std::invalid_argument("No element with given key");
+    }
 
-        auto &elements_of_same_key = map_iter->second;
-        elements->erase(elements_of_same_key.front());
-        elements_of_same_key.pop_front();
+    // Removes the first n elements
+    void pop_n(size_t n)
+    {
+        throw_exception_if_moved();
+
+        if (elements->size < n)
+            throw std::invalid_argument("Not enough elements in queue");
+        if (n == 0)
+            return;
+
+        try_detach();
+
+        elements->pop_n(n);
+    }
+
+    // Removes the first n elements with key k
+    void pop_n(K const &k, size_t n)
+    {
+        throw_exception_if_moved();
 
-        if (elements_of_same_key.empty())
-            elements_by_key->erase(k);
+        if (n == 0)
+            return;
+
+        try_detach();
+
+        if (!elements->pop_n(k, n))
+            throw std::invalid_argument("Not enough elements with given key");
     }
 
     void move_to_back(K const &k)
@@ -175,13 +244,8 @@ requires std::totally_ordered<K> && std::semiregular<K>
 
         try_detach();
 
-        auto map_iter = elements_by_key->find(k);
-        if (map_iter == elements_by_key->end())
+        if (!elements->move_to_back(k))
             throw std::invalid_argument("No element with given key");
-
-        auto &elements_of_same_key = map_iter->second;
-        for (const auto &elements_iter : elements_of_same_key)
-            elements->splice(elements->end(), *elements, elements_iter);
     }
 
     std::pair<K const &, V &> front()
@@ -191,20 +255,22 @@ requires std::totally_ordered<K> && std::semiregular<K>
         try_detach();
         cannot_share = true;
 
-        if (elements->empty())
+        if (elements->size == 0)
             throw std::invalid_argument("Queue is empty");
 
-        return {elements->front().first, elements->front().second};
+        auto &element = elements->item(elements->head);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V const &> front() const
     {
         throw_exception_if_moved();
 
-        if (elements->empty())
+        if (elements->size == 0)
             throw std::invalid_argument("Queue is empty");
 
-        return {elements->front().first, elements->front().second};
+        auto &element = std::as_const(*elements).item(elements->head);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V &> back()
@@ -214,20 +280,22 @@ requires std::totally_ordered<K> && std::semiregular<K>
         try_detach();
         cannot_share = true;
 
-        if (elements->empty())
+        if (elements->size == 0)
             throw std::invalid_argument("Queue is empty");
 
-        return {elements->back().first, elements->back().second};
+        auto &element = elements->item(elements->tail);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V const &> back() const
     {
         throw_exception_if_moved();
 
-        if (elements->empty())
+        if (elements->size == 0)
             throw std::invalid_argument("Queue is empty");
 
-        return {elements->back().first, elements->back().second};
+        auto &element = std::as_const(*elements).item(elements->tail);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V &> first(K const &key)
@@ -237,24 +305,24 @@ requires std::totally_ordered<K> && std::semiregular<K>
         try_detach();
         cannot_share = true;
 
-        auto map_iter = elements_by_key->find(key);
-        if (map_iter == elements_by_key->end())
+        auto elements_of_same_key = elements->index.find(key);
+        if (!elements_of_same_key)
             throw std::invalid_argument("No element with given key");
 
-        auto &elements_of_same_key = map_iter->second;
-        return {elements_of_same_key.front()->first, elements_of_same_key.front()->second};
+        auto &element = elements->item(elements_of_same_key->head);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V const &> first(K const &key) const
     {
         throw_exception_if_moved();
 
-        auto map_iter = elements_by_key->find(key);
-        if (map_iter == elements_by_key->end())
+        auto elements_of_same_key = elements->index.find(key);
+        if (!elements_of_same_key)
             throw std::invalid_argument("No element with given key");
 
-        auto &elements_of_same_key = map_iter->second;
-        return {elements_of_same_key.front()->first, elements_of_same_key.front()->second};
+        auto &element = std::as_const(*elements).item(elements_of_same_key->head);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V &> last(K const &key)
@@ -264,38 +332,38 @@ requires std::totally_ordered<K> && std::semiregular<K>
         try_detach();
         cannot_share = true;
 
-        auto map_iter = elements_by_key->find(key);
-        if (map_iter == elements_by_key->end())
+        auto elements_of_same_key = elements->index.find(key);
+        if (!elements_of_same_key)
             throw std::invalid_argument("No element with given key");
 
-        auto &elements_of_same_key = map_iter->second;
-        return {elements_of_same_key.back()->first, elements_of_same_key.back()->second};
+        auto &element = elements->item(elements_of_same_key->tail);
+        return {element.first, element.second};
     }
 
     std::pair<K const &, V const &> last(K const &key) const
     {
         throw_exception_if_moved();
 
-        auto map_iter = elements_by_key->find(key);
-        if (map_iter == elements_by_key->end())
+        auto elements_of_same_key = elements->index.find(key);
+        if (!elements_of_same_key)
             throw std::invalid_argument("No element with given key");
 
-        auto &elements_of_same_key = map_iter->second;
-        return {elements_of_same_key.back()->first, elements_of_same_key.back()->second};
+        auto &element = std::as_const(*elements).item(elements_of_same_key->tail);
+        return {element.first, element.second};
     }
 
     size_t size() const noexcept
     {
         if (!elements.get())
             return 0;
-        return elements->size();
+        return elements->size;
     }
 
     bool empty() const noexcept
     {
         if (!elements)
             return true;
-        return elements->empty();
+        return elements->size == 0;
     }
 
     size_t count(K const &k) const
@@ -303,11 +371,11 @@ requires std::totally_ordered<K> && std::semiregular<K>
         if (!elements)
             return 0;
 
-        auto map_iter = elements_by_key->find(k);
-        if (map_iter == elements_by_key->end())
+        auto elements_of_same_key = elements->index.find(k);
+        if (!elements_of_same_key)
             return 0;
 
-        return map_iter->second.size();
+        return elements_of_same_key->count;
     }
 
     void clear()
@@ -319,69 +387,92 @@ requires std::totally_ordered<K> && std::semiregular<K>
 
         cannot_share = false;
         elements->clear();
-        elements_by_key->clear();
     }
 
-    k_iterator<K, V> k_begin() const
+    // Views of elements in FIFO order: items() of all of them as pairs of
+    // key and value, values(k) of values with key k. They are lazy and, like
+    // references returned by const methods, valid until *this is modified.
+    auto items() const noexcept
     {
-        return k_iterator<K, V>(elements_by_key->begin());
+        using iterator = kvfifo_detail::item_iterator<K, V, false>;
+        if (!elements)
+            return std::ranges::subrange(iterator(), iterator(), 0);
+
+        return std::ranges::subrange(iterator(&elements->nodes, elements->head),
+                                     iterator(), elements->size);
     }
 
-    k_iterator<K, V> k_end() const
+    auto values(K const &k) const
     {
-        return k_iterator<K, V>(elements_by_key->end());
+        using iterator = kvfifo_detail::item_iterator<K, V, true>;
+        if (!elements)
+            return std::ranges::subrange(iterator(), iterator(), 0);
+
+        auto elements_of_same_key = elements->index.find(k);
+        if (!elements_of_same_key)
+            return std::ranges::subrange(iterator(), iterator(), 0);
+
+        return std::ranges::subrange(
+            iterator(&elements->nodes, elements_of_same_key->head), iterator(),
+            elements_of_same_key->count);
     }
 
-private:
-    bool cannot_share = false;
-    std::shared_ptr<list_t<K, V>> elements;
-    std::shared_ptr<map_t<K, V>> elements_by_key;
+    auto k_begin() const
+    requires std::same_as<Index, kvfifo_ordered>
+    {
+        return k_iterator<K, V>(elements->index.begin());
+    }
 
-    static std::shared_ptr<list_t<K, V>> empty_list() 
+    auto k_end() const
+    requires std::same_as<Index, kvfifo_ordered>
     {
-        static const auto empty_l = std::make_shared<list_t<K, V>>();
-        return empty_l;
+        return k_iterator<K, V>(elements->index.end());
     }
-    static std::shared_ptr<map_t<K, V>> empty_map() 
+
+private:
+    bool cannot_share = false;
+    std::shared_ptr<storage_t<K, V, Index>> elements;
+
+    static std::shared_ptr<storage_t<K, V, Index>> empty_storage()
     {
-        static const auto empty_m = std::make_shared<map_t<K, V>>();
-        return empty_m;
+        static const auto empty_s = std::make_shared<storage_t<K, V, Index>>();
+        return empty_s;
     }
 
     void swap(kvfifo &other) noexcept
     {
         elements.swap(other.elements);
-        elements_by_key.swap(other.elements_by_key);
         std::swap(cannot_share, other.cannot_share);
     }
 
     // Calls detach() if current object shares data with any other kvfifo object
     void try_detach()
     {
-        if (elements.use_count() <= 1)
+        if (kvfifo_detail::unique(elements))
             return;
 
         detach();
     }
 
-    // Makes copy of stored data
+    // Makes copy of stored data. The copy shares nodes and index entries with
+    // the original until they are modified, so this costs O(1), and the first
+    // modification of an element afterwards costs O(CHUNK + log n).
     void detach()
     {
-        auto tmp_elements(std::make_shared<list_t<K, V>>(*elements));
-        auto tmp_elements_by_key(std::make_shared<map_t<K, V>>());
+        auto tmp_elements(std::make_shared<storage_t<K, V, Index>>(*elements));
 
-        for (auto list_iter = tmp_elements->begin(); list_iter != tmp_elements->end();
-             ++list_iter)
-        {
-            auto map_iter = tmp_elements_by_key->find(list_iter->first);
-            if (map_iter == tmp_elements_by_key->end())
-                map_iter = tmp_elements_by_key->insert({list_iter->first, {}}).first;
+        elements.swap(tmp_elements);
+        cannot_share = false;
+    }
 
-            map_iter->second.push_back(list_iter);
-        }
+    // Makes copy of stored data that shares no element with the original,
+    // because references to elements of the original were given out
+    void detach_elements()
+    {
+        auto tmp_elements(std::make_shared<storage_t<K, V, Index>>(*elements));
+        tmp_elements->nodes.unshare();
 
         elements.swap(tmp_elements);
-        elements_by_key.swap(tmp_elements_by_key);
         cannot_share = false;
     }
 
@@ -393,4 +484,7 @@ private:
     }
 };
 
+template <typename K, typename V>
+using unordered_kvfifo = kvfifo<K, V, kvfifo_hashed>;
+
 #endif
\ No newline at end of file
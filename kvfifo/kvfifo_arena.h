@@ -0,0 +1,716 @@
+#ifndef KVFIFO_ARENA_H
+#define KVFIFO_ARENA_H
+
+#include "kvfifo_index.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kvfifo_detail
+{
+// Position of a node in the arena; NONE is not a position, so an arena has
+// at most NONE nodes
+using position_t = std::uint32_t;
+
+inline constexpr position_t NONE = std::numeric_limits<position_t>::max();
+
+// Element of the queue. Node holds both links of the global FIFO and the link
+// to the next element with the same key, so one element is one node.
+template <typename K, typename V> struct node
+{
+    std::optional<std::pair<K, V>> item;
+    position_t prev = NONE;
+    // For a free node: next node on the free list
+    position_t next = NONE;
+    position_t key_next = NONE;
+};
+
+// Elements with the same key, linked through node::key_next
+struct chain
+{
+    position_t head;
+    position_t tail;
+    std::size_t count;
+};
+
+// Nodes are allocated in chunks of CHUNK and reused through the free list, so
+// pushing an element allocates memory only when all chunks are full.
+//
+// Chunks are leaves of a radix tree with CHUNK children per branch. Copying
+// the arena copies only the root pointer; writing a node copies the chunk
+// holding it and the branches above it if they are shared with other copies.
+// A node is written through operator[], which copies what is needed and may
+// throw; prepare() does the same in advance, so that later writes of the
+// prepared node do not throw.
+template <typename K, typename V> class arena
+{
+  public:
+    static constexpr unsigned BITS = 6;
+    static constexpr std::size_t CHUNK = std::size_t(1) << BITS;
+
+    node<K, V> const &operator[](position_t position) const noexcept
+    {
+        void const *block = root.get();
+        for (unsigned level = depth; level > 0; --level)
+            block = static_cast<branch const *>(block)
+                        ->children[child(position, level)]
+                        .get();
+        return static_cast<chunk const *>(block)->nodes[position % CHUNK];
+    }
+
+    node<K, V> &operator[](position_t position)
+    {
+        std::shared_ptr<void> *block = &root;
+        for (unsigned level = depth; level > 0; --level)
+            block = &own<branch>(*block).children[child(position, level)];
+        return own<chunk>(*block).nodes[position % CHUNK];
+    }
+
+    void prepare(position_t position)
+    {
+        (*this)[position];
+    }
+
+    // Returns position of a prepared node with empty item
+    position_t allocate()
+    {
+        if (free_head != NONE)
+        {
+            position_t const position = free_head;
+            free_head = (*this)[position].next;
+            return position;
+        }
+
+        if (used == NONE)
+            throw std::length_error("Too many elements");
+        if (used % CHUNK == 0)
+            add_chunk();
+        prepare(used);
+        return used++;
+    }
+
+    // Destroys item of a prepared node and returns it to the free list
+    void release(position_t position) noexcept
+    {
+        node<K, V> &released = (*this)[position];
+        released.item.reset();
+        released.next = free_head;
+        free_head = position;
+    }
+
+    // Destroys items of prepared nodes first ... last, which are linked
+    // through next, and moves all of them to the free list at once
+    void release(position_t first, position_t last) noexcept
+    {
+        for (position_t position = first;; position = (*this)[position].next)
+        {
+            (*this)[position].item.reset();
+            if (position == last)
+                break;
+        }
+        (*this)[last].next = free_head;
+        free_head = first;
+    }
+
+    // Copies all chunks shared with other copies of the arena
+    void unshare()
+    {
+        if (root)
+            root = copy_tree(root, depth);
+    }
+
+    void clear() noexcept
+    {
+        root.reset();
+        depth = 0;
+        free_head = NONE;
+        used = 0;
+    }
+
+  private:
+    struct chunk
+    {
+        std::array<node<K, V>, CHUNK> nodes;
+    };
+
+    // Children of a branch are branches, or chunks for the lowest branches
+    struct branch
+    {
+        std::array<std::shared_ptr<void>, CHUNK> children;
+    };
+
+    // Chunk when depth == 0
+    std::shared_ptr<void> root;
+    unsigned depth = 0;
+    position_t free_head = NONE;
+    position_t used = 0;
+
+    static std::size_t child(position_t position, unsigned level) noexcept
+    {
+        return (position >> (BITS * level)) % CHUNK;
+    }
+
+    // Chunks of values that can not be copied are never shared, because
+    // kvfifo holding them can not be copied
+    template <typename Block> static Block &own(std::shared_ptr<void> &block)
+    {
+        if constexpr (std::is_copy_constructible_v<Block>)
+            if (!unique(block))
+                block = std::make_shared<Block>(*static_cast<Block const *>(block.get()));
+        return *static_cast<Block *>(block.get());
+    }
+
+    static std::shared_ptr<void> copy_tree(std::shared_ptr<void> const &block,
+                                           unsigned level)
+    {
+        if (level == 0)
+            return std::make_shared<chunk>(*static_cast<chunk const *>(block.get()));
+
+        auto copy = std::make_shared<branch>();
+        auto const &children = static_cast<branch const *>(block.get())->children;
+        for (std::size_t i = 0; i < CHUNK && children[i]; ++i)
+            copy->children[i] = copy_tree(children[i], level - 1);
+        return copy;
+    }
+
+    // Adds the chunk for positions used ... used + CHUNK - 1. Empty chunk and
+    // branches are added first, so if it throws nothing is lost.
+    void add_chunk()
+    {
+        if (!root)
+        {
+            root = std::make_shared<chunk>();
+            return;
+        }
+
+        if (used >> (BITS * (depth + 1)) != 0)
+        {
+            auto grown = std::make_shared<branch>();
+            grown->children[0] = root;
+            root = std::move(grown);
+            ++depth;
+        }
+
+        std::shared_ptr<void> *block = &root;
+        for (unsigned level = depth; level > 0; --level)
+        {
+            block = &own<branch>(*block).children[child(used, level)];
+            if (!*block)
+            {
+                if (level > 1)
+                    *block = std::make_shared<branch>();
+                else
+                    *block = std::make_shared<chunk>();
+            }
+        }
+    }
+};
+
+// Forward iterator over elements in FIFO order: over all of them, following
+// node::next, or over the values of one key, following node::key_next. It
+// only reads nodes, so it is valid until the arena is modified.
+template <typename K, typename V, bool SAME_KEY> class item_iterator
+{
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = std::conditional_t<SAME_KEY, V, std::pair<K, V>>;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+    item_iterator() = default;
+    item_iterator(arena<K, V> const *nodes, position_t position) noexcept
+        : nodes(nodes), position(position)
+    {}
+
+    reference operator*() const noexcept
+    {
+        std::pair<K, V> const &item = *(*nodes)[position].item;
+        if constexpr (SAME_KEY)
+            return item.second;
+        else
+            return item;
+    }
+
+    pointer operator->() const noexcept
+    {
+        return &**this;
+    }
+
+    item_iterator &operator++() noexcept
+    {
+        node<K, V> const &current = (*nodes)[position];
+        position = SAME_KEY ? current.key_next : current.next;
+        return *this;
+    }
+
+    item_iterator operator++(int) noexcept
+    {
+        item_iterator tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    bool operator==(item_iterator const &other) const noexcept
+    {
+        return position == other.position;
+    }
+
+  private:
+    arena<K, V> const *nodes = nullptr;
+    position_t position = NONE;
+};
+
+// Queue stored in an arena: global FIFO is a doubly linked list of nodes,
+// index (of the Index policy) maps every key to the chain of its elements.
+// Copying the storage is
+// O(1); both copies share nodes until one of them modifies them.
+//
+// Modifications prepare every node and index entry they change before
+// changing anything, so they either succeed or leave the storage unchanged.
+template <typename K, typename V, typename Index> struct storage
+{
+    using index_t = typename Index::template index<K, chain>;
+
+    arena<K, V> nodes;
+    index_t index;
+    position_t head = NONE;
+    position_t tail = NONE;
+    std::size_t size = 0;
+
+    std::pair<K, V> &item(position_t position)
+    {
+        return *nodes[position].item;
+    }
+
+    std::pair<K, V> const &item(position_t position) const noexcept
+    {
+        return *nodes[position].item;
+    }
+
+    // Adds element constructed from k and args. If constructing it can not
+    // throw, the index is updated first, so that k and args are not moved
+    // from when push() throws.
+    template <typename KArg, typename... Args> void push(KArg &&k, Args &&...args)
+    {
+        constexpr bool nothrow_item =
+            std::is_nothrow_constructible_v<K, KArg> &&
+            std::is_nothrow_constructible_v<V, Args...>;
+
+        chain *elements_of_same_key = index.write(k);
+        position_t const position = nodes.allocate();
+        node<K, V> &created = nodes[position];
+        node<K, V> *last;
+        node<K, V> *key_last;
+        try
+        {
+            last = tail != NONE ? &nodes[tail] : nullptr;
+            key_last =
+                elements_of_same_key ? &nodes[elements_of_same_key->tail] : nullptr;
+            if (nothrow_item && !elements_of_same_key)
+                elements_of_same_key =
+                    &index.insert(k, chain{position, position, 0});
+            created.item.emplace(std::piecewise_construct,
+                                 std::forward_as_tuple(std::forward<KArg>(k)),
+                                 std::forward_as_tuple(std::forward<Args>(args)...));
+            if (!elements_of_same_key)
+                elements_of_same_key = &index.insert(created.item->first,
+                                                     chain{position, position, 0});
+        }
+        catch (...)
+        {
+            nodes.release(position);
+            throw;
+        }
+
+        created.key_next = NONE;
+        link_back(position, created, last);
+        if (key_last)
+        {
+            key_last->key_next = position;
+            elements_of_same_key->tail = position;
+        }
+        ++elements_of_same_key->count;
+    }
+
+    // Removes the first element with key k. Returns false if there is none.
+    bool pop(K const &k)
+    {
+        chain *elements_of_same_key = index.write(k);
+        if (!elements_of_same_key)
+            return false;
+
+        position_t const position = elements_of_same_key->head;
+        node<K, V> &popped = nodes[position];
+        auto [prev, next] = neighbours(popped);
+
+        if (elements_of_same_key->count == 1)
+            index.erase(k);
+        else
+        {
+            elements_of_same_key->head = popped.key_next;
+            --elements_of_same_key->count;
+        }
+
+        unlink(popped, prev, next);
+        nodes.release(position);
+        return true;
+    }
+
+    // Moves elements with key k to the back. Returns false if there are none.
+    bool move_to_back(K const &k)
+    {
+        chain const *elements_of_same_key = index.find(k);
+        if (!elements_of_same_key)
+            return false;
+
+        nodes.prepare(tail);
+        for (position_t position = elements_of_same_key->head; position != NONE;)
+        {
+            node<K, V> &moved = nodes[position];
+            neighbours(moved);
+            position = moved.key_next;
+        }
+
+        for (position_t position = elements_of_same_key->head; position != NONE;)
+        {
+            node<K, V> &moved = nodes[position];
+            auto [prev, next] = neighbours(moved);
+            unlink(moved, prev, next);
+            link_back(position, moved, tail != NONE ? &nodes[tail] : nullptr);
+            position = moved.key_next;
+        }
+        return true;
+    }
+
+    // Adds elements of the range, which are pairs of key and value. They are
+    // linked into a segment of new nodes, in runs of consecutive elements
+    // with the same key, then the index is updated once per run and the
+    // segment is spliced onto the back.
+    template <typename Range> void push_range(Range &&range)
+    {
+        std::vector<group> runs;
+        chain segment{NONE, NONE, 0};
+        try
+        {
+            if constexpr (std::ranges::sized_range<Range>)
+                runs.reserve(std::ranges::size(range));
+            for (auto &&element : range)
+                stage(segment, runs, std::forward<decltype(element)>(element));
+            if (segment.count == 0)
+                return;
+
+            bool new_keys = false;
+            if (tail != NONE)
+                nodes.prepare(tail);
+            for (group &run : runs)
+            {
+                run.target = index.write(*run.key);
+                if (run.target)
+                    nodes.prepare(run.target->tail);
+                else
+                    new_keys = true;
+            }
+
+            if (!new_keys)
+                for (group &run : runs)
+                    join(run, *run.target);
+            else
+            {
+                // Inserting keys is the only change that can throw, so it is
+                // done on the index that can be restored
+                index_t const saved(index);
+                try
+                {
+                    for (group &run : runs)
+                    {
+                        if (chain *elements_of_same_key = index.write(*run.key))
+                            join(run, *elements_of_same_key);
+                        else
+                        {
+                            index.insert(*run.key, run.elements);
+                            run.after = NONE;
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    index = saved;
+                    throw;
+                }
+            }
+        }
+        catch (...)
+        {
+            if (segment.count != 0)
+                nodes.release(segment.head, segment.tail);
+            throw;
+        }
+
+        for (group const &run : runs)
+            if (run.after != NONE)
+                nodes[run.after].key_next = run.elements.head;
+        nodes[segment.head].prev = tail;
+        if (tail != NONE)
+            nodes[tail].next = segment.head;
+        else
+            head = segment.head;
+        tail = segment.tail;
+        size += segment.count;
+    }
+
+    // Removes the first n elements, 0 < n <= size. Elements of every key
+    // removed are a prefix of its chain, so the index is updated once per
+    // key, and the removed nodes are moved to the free list at once.
+    void pop_n(std::size_t n)
+    {
+        if (n == size)
+        {
+            clear();
+            return;
+        }
+
+        // While the batch is prepared, prev of every removed node is set to
+        // NONE, which no node that stays has. Going from the head, the number
+        // of removed elements of a key so far is passed on to the next one
+        // in prev, so an element whose key_next does not have prev NONE is
+        // the last removed element of its key.
+        position_t last = head;
+        position_t marked = NONE;
+        std::vector<group> keys;
+        bool erased_keys = false;
+        try
+        {
+            for (std::size_t i = 1;; ++i)
+            {
+                nodes[last].prev = NONE;
+                marked = last;
+                if (i == n)
+                    break;
+                last = std::as_const(nodes)[last].next;
+            }
+            nodes.prepare(std::as_const(nodes)[last].next);
+            keys.reserve(std::min(n, index.size()));
+
+            for (position_t position = head;;)
+            {
+                node<K, V> &removed = nodes[position];
+                position_t const count = removed.prev == NONE ? 1 : removed.prev;
+                if (removed.key_next != NONE &&
+                    std::as_const(nodes)[removed.key_next].prev == NONE)
+                    nodes[removed.key_next].prev = count + 1;
+                else
+                {
+                    K const &key = removed.item->first;
+                    chain *elements_of_same_key = index.write(key);
+                    keys.push_back(group{chain{removed.key_next, position, count},
+                                         elements_of_same_key, NONE, &key});
+                    if (removed.key_next == NONE)
+                    {
+                        keys.back().target = nullptr;
+                        erased_keys = true;
+                    }
+                }
+                if (position == last)
+                    break;
+                position = removed.next;
+            }
+
+            if (erased_keys)
+            {
+                index_t const saved(index);
+                try
+                {
+                    for (group &removed : keys)
+                        if (!removed.target)
+                            index.erase(*removed.key);
+                    for (group &removed : keys)
+                        if (removed.target)
+                            removed.target = index.write(*removed.key);
+                }
+                catch (...)
+                {
+                    index = saved;
+                    throw;
+                }
+            }
+        }
+        catch (...)
+        {
+            for (position_t position = head, prev = NONE; prev != marked;)
+            {
+                node<K, V> &removed = nodes[position];
+                removed.prev = prev;
+                prev = position;
+                position = removed.next;
+            }
+            throw;
+        }
+
+        for (group const &removed : keys)
+            if (chain *elements_of_same_key = removed.target)
+            {
+                elements_of_same_key->head = removed.elements.head;
+                elements_of_same_key->count -= removed.elements.count;
+            }
+
+        position_t const new_head = std::as_const(nodes)[last].next;
+        nodes.release(head, last);
+        head = new_head;
+        nodes[head].prev = NONE;
+        size -= n;
+    }
+
+    // Removes the first n elements with key k. Returns false if there are
+    // fewer of them.
+    bool pop_n(K const &k, std::size_t n)
+    {
+        chain *elements_of_same_key = index.write(k);
+        if (!elements_of_same_key || elements_of_same_key->count < n)
+            return false;
+
+        position_t const first = elements_of_same_key->head;
+        position_t position = first;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            node<K, V> &popped = nodes[position];
+            neighbours(popped);
+            position = popped.key_next;
+        }
+
+        if (elements_of_same_key->count == n)
+            index.erase(k);
+        else
+        {
+            elements_of_same_key->head = position;
+            elements_of_same_key->count -= n;
+        }
+
+        for (position_t popped_position = first; popped_position != position;)
+        {
+            node<K, V> &popped = nodes[popped_position];
+            auto [prev, next] = neighbours(popped);
+            position_t const key_next = popped.key_next;
+            unlink(popped, prev, next);
+            nodes.release(popped_position);
+            popped_position = key_next;
+        }
+        return true;
+    }
+
+    void clear() noexcept
+    {
+        index.clear();
+        nodes.clear();
+        head = tail = NONE;
+        size = 0;
+    }
+
+  private:
+    // Elements of one key in a batch. While the batch is applied, target is
+    // the chain of that key in the index and after is the element after
+    // which pushed elements are linked. For removed elements, head is the
+    // first element of the key that is left.
+    struct group
+    {
+        chain elements;
+        chain *target;
+        position_t after;
+        K const *key;
+    };
+
+    // Constructs the element in a new node at the end of the segment and
+    // adds it to the run of its key
+    template <typename Element>
+    void stage(chain &segment, std::vector<group> &runs, Element &&element)
+    {
+        position_t const position = nodes.allocate();
+        node<K, V> &created = nodes[position];
+        try
+        {
+            created.item.emplace(std::forward<Element>(element));
+        }
+        catch (...)
+        {
+            nodes.release(position);
+            throw;
+        }
+
+        position_t const previous = segment.tail;
+        created.prev = previous;
+        created.next = NONE;
+        created.key_next = NONE;
+        if (previous != NONE)
+            nodes[previous].next = position;
+        else
+            segment.head = position;
+        segment.tail = position;
+        ++segment.count;
+
+        if (previous != NONE && *runs.back().key == created.item->first)
+        {
+            nodes[previous].key_next = position;
+            runs.back().elements.tail = position;
+            ++runs.back().elements.count;
+            return;
+        }
+        runs.push_back(
+            group{chain{position, position, 1}, nullptr, NONE, &created.item->first});
+    }
+
+    // Appends the run to the chain of its key in the index
+    static void join(group &run, chain &elements_of_same_key) noexcept
+    {
+        run.after = elements_of_same_key.tail;
+        elements_of_same_key.tail = run.elements.tail;
+        elements_of_same_key.count += run.elements.count;
+    }
+
+    std::pair<node<K, V> *, node<K, V> *> neighbours(node<K, V> const &n)
+    {
+        return {n.prev != NONE ? &nodes[n.prev] : nullptr,
+                n.next != NONE ? &nodes[n.next] : nullptr};
+    }
+
+    // Nodes passed to link_back() and unlink() are already prepared
+    void link_back(position_t position, node<K, V> &linked,
+                   node<K, V> *last) noexcept
+    {
+        linked.prev = tail;
+        linked.next = NONE;
+        if (last)
+            last->next = position;
+        else
+            head = position;
+        tail = position;
+        ++size;
+    }
+
+    void unlink(node<K, V> &unlinked, node<K, V> *prev, node<K, V> *next) noexcept
+    {
+        if (prev)
+            prev->next = unlinked.next;
+        else
+            head = unlinked.next;
+        if (next)
+            next->prev = unlinked.prev;
+        else
+            tail = unlinked.prev;
+        --size;
+    }
+};
+} // namespace kvfifo_detail
+
+#endif
@@ -0,0 +1,764 @@
+#ifndef KVFIFO_INDEX_H
+#define KVFIFO_INDEX_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kvfifo_detail
+{
+// Whether link is the only reference to its block, so that the block may be
+// modified in place. Other references may have been released by other
+// threads; use_count() does not synchronize with that, so the fence orders
+// everything they did with the block before what the caller does next.
+template <typename Block> bool unique(std::shared_ptr<Block> const &link) noexcept
+{
+    if (link.use_count() > 1)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+// Copy-on-write of one shared node: after own(link) the node is referenced
+// only by link, so it may be modified without affecting other copies.
+template <typename Node> Node &own(std::shared_ptr<Node> &link)
+{
+    if (!unique(link))
+        link = std::make_shared<Node>(*link);
+    return *link;
+}
+
+// Persistent AVL tree mapping keys to values. Copying the tree copies only
+// the root pointer; a modification copies the nodes it changes that are
+// shared with other copies, which is O(log n) nodes.
+//
+// Every modification first makes the nodes it is going to change unique and
+// allocates new nodes, and only then relinks them, so if it throws the tree
+// is left unchanged.
+template <typename K, typename T> class ordered_index
+{
+    struct tree_node;
+    using link_t = std::shared_ptr<tree_node>;
+
+    struct tree_node
+    {
+        K key;
+        T value;
+        link_t left;
+        link_t right;
+        int height = 1;
+    };
+
+  public:
+    // Bidirectional iterator over keys in increasing order. It keeps the path
+    // from the root to its key, so moving to the next or previous key costs
+    // amortized O(1). It also holds the root that path starts at, so that
+    // version of the tree stays alive and is not modified in place: a
+    // modification of the tree copies the nodes it changes, as for a copy of
+    // the tree. The iterator then finds its path again from the new root, in
+    // O(log n), so it stays valid when other keys are inserted or removed.
+    class const_iterator
+    {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = std::pair<K const, T>;
+
+        const_iterator() = default;
+
+        K const &key() const noexcept
+        {
+            return current->key;
+        }
+
+        T const &value() const noexcept
+        {
+            return current->value;
+        }
+
+        const_iterator &operator++() noexcept
+        {
+            find_path();
+            if (tree_node const *n = path[depth - 1]->right.get())
+                descend(n, &tree_node::left);
+            else
+                ascend(&tree_node::right);
+            return *this;
+        }
+
+        const_iterator &operator--() noexcept
+        {
+            if (!current)
+            {
+                depth = 0;
+                root = index->root;
+                descend(root.get(), &tree_node::right);
+                return *this;
+            }
+
+            find_path();
+            if (tree_node const *n = path[depth - 1]->left.get())
+                descend(n, &tree_node::right);
+            else
+                ascend(&tree_node::left);
+            return *this;
+        }
+
+        bool operator==(const_iterator const &other) const noexcept
+        {
+            return current == other.current;
+        }
+
+      private:
+        friend class ordered_index;
+
+        using child_t = link_t tree_node::*;
+
+        // An AVL tree of height MAX_DEPTH would need more than 2^44 nodes
+        static constexpr std::size_t MAX_DEPTH = 64;
+
+        const_iterator(ordered_index const *index, link_t root)
+            : index(index), root(std::move(root))
+        {}
+
+        ordered_index const *index = nullptr;
+        // Keeps current and the nodes on path alive
+        link_t root;
+        tree_node const *current = nullptr;
+        std::size_t depth = 0;
+        std::array<tree_node const *, MAX_DEPTH> path{};
+
+        // Goes down from n, and then from each node to its child, as long
+        // as there is one
+        void descend(tree_node const *n, child_t child) noexcept
+        {
+            for (; n; n = (n->*child).get())
+                path[depth++] = n;
+            current = depth != 0 ? path[depth - 1] : nullptr;
+        }
+
+        // Goes up to the first ancestor that the path does not leave
+        // through its child
+        void ascend(child_t child) noexcept
+        {
+            tree_node const *left;
+            do
+                left = path[--depth];
+            while (depth != 0 && (path[depth - 1]->*child).get() == left);
+            current = depth != 0 ? path[depth - 1] : nullptr;
+        }
+
+        // Rebuilds the path to the current key if the tree was modified. The
+        // old root is released only after the key has been found.
+        void find_path() noexcept
+        {
+            if (root == index->root)
+                return;
+
+            K const &key = current->key;
+            depth = 0;
+            for (tree_node const *n = index->root.get(); n;)
+            {
+                path[depth++] = n;
+                if (key < n->key)
+                    n = n->left.get();
+                else if (n->key < key)
+                    n = n->right.get();
+                else
+                    break;
+            }
+            current = path[depth - 1];
+            root = index->root;
+        }
+    };
+
+    std::size_t size() const noexcept
+    {
+        return count;
+    }
+
+    T const *find(K const &key) const noexcept
+    {
+        for (tree_node const *n = root.get(); n;)
+        {
+            if (key < n->key)
+                n = n->left.get();
+            else if (n->key < key)
+                n = n->right.get();
+            else
+                return &n->value;
+        }
+        return nullptr;
+    }
+
+    // Value of the key, which can be modified, or nullptr if there is no such
+    // key
+    T *write(K const &key)
+    {
+        for (link_t *link = &root; *link;)
+        {
+            tree_node &n = own(*link);
+            if (key < n.key)
+                link = &n.left;
+            else if (n.key < key)
+                link = &n.right;
+            else
+                return &n.value;
+        }
+        return nullptr;
+    }
+
+    // Adds a key that is not in the tree and returns its value
+    T &insert(K const &key, T const &value)
+    {
+        link_t created = std::make_shared<tree_node>(key, value);
+        for (link_t *link = &root; *link;)
+        {
+            tree_node &n = own(*link);
+            link = key < n.key ? &n.left : &n.right;
+        }
+
+        T &inserted = created->value;
+        attach(root, created);
+        ++count;
+        return inserted;
+    }
+
+    // Removes a key that is in the tree
+    void erase(K const &key)
+    {
+        // Rebalancing after the removal rotates nodes on the path to the key
+        // (and on to its successor) together with the other child of every
+        // such node and that child's children.
+        link_t *link = &root;
+        while (true)
+        {
+            tree_node &n = own(*link);
+            if (key < n.key)
+            {
+                own_top(n.right);
+                link = &n.left;
+            }
+            else if (n.key < key)
+            {
+                own_top(n.left);
+                link = &n.right;
+            }
+            else
+                break;
+        }
+
+        tree_node &removed = **link;
+        if (removed.left && removed.right)
+        {
+            own_top(removed.left);
+            for (link_t *next = &removed.right; *next;)
+            {
+                tree_node &n = own(*next);
+                own_top(n.right);
+                next = &n.left;
+            }
+        }
+
+        remove(root, key);
+        --count;
+    }
+
+    void clear() noexcept
+    {
+        root.reset();
+        count = 0;
+    }
+
+    const_iterator begin() const noexcept
+    {
+        const_iterator first(this, root);
+        first.descend(root.get(), &tree_node::left);
+        return first;
+    }
+
+    const_iterator end() const noexcept
+    {
+        return const_iterator(this, nullptr);
+    }
+
+  private:
+    link_t root;
+    std::size_t count = 0;
+
+    static void own_top(link_t &link)
+    {
+        if (!link)
+            return;
+        tree_node &n = own(link);
+        if (n.left)
+            own(n.left);
+        if (n.right)
+            own(n.right);
+    }
+
+    static int height(link_t const &link) noexcept
+    {
+        return link ? link->height : 0;
+    }
+
+    static void update(tree_node &n) noexcept
+    {
+        n.height = 1 + std::max(height(n.left), height(n.right));
+    }
+
+    static void rotate_left(link_t &link) noexcept
+    {
+        link_t right = std::move(link->right);
+        link->right = std::move(right->left);
+        update(*link);
+        right->left = std::move(link);
+        update(*right);
+        link = std::move(right);
+    }
+
+    static void rotate_right(link_t &link) noexcept
+    {
+        link_t left = std::move(link->left);
+        link->left = std::move(left->right);
+        update(*link);
+        left->right = std::move(link);
+        update(*left);
+        link = std::move(left);
+    }
+
+    static void rebalance(link_t &link) noexcept
+    {
+        tree_node &n = *link;
+        int const balance = height(n.right) - height(n.left);
+        if (balance > 1)
+        {
+            if (height(n.right->left) > height(n.right->right))
+                rotate_right(n.right);
+            rotate_left(link);
+        }
+        else if (balance < -1)
+        {
+            if (height(n.left->right) > height(n.left->left))
+                rotate_left(n.left);
+            rotate_right(link);
+        }
+        else
+            update(n);
+    }
+
+    static void attach(link_t &link, link_t &created) noexcept
+    {
+        if (!link)
+        {
+            link = std::move(created);
+            return;
+        }
+
+        attach(created->key < link->key ? link->left : link->right, created);
+        rebalance(link);
+    }
+
+    // Unlinks the node with the smallest key from the subtree
+    static link_t detach_min(link_t &link) noexcept
+    {
+        if (!link->left)
+        {
+            link_t min = std::move(link);
+            link = std::move(min->right);
+            return min;
+        }
+
+        link_t min = detach_min(link->left);
+        rebalance(link);
+        return min;
+    }
+
+    static void remove(link_t &link, K const &key) noexcept
+    {
+        tree_node &n = *link;
+        if (key < n.key)
+            remove(n.left, key);
+        else if (n.key < key)
+            remove(n.right, key);
+        else if (!n.left || !n.right)
+        {
+            link_t child = n.left ? std::move(n.left) : std::move(n.right);
+            link = std::move(child);
+            return;
+        }
+        else
+        {
+            link_t successor = detach_min(n.right);
+            successor->left = std::move(n.left);
+            successor->right = std::move(n.right);
+            link = std::move(successor);
+        }
+        rebalance(link);
+    }
+};
+
+// Persistent hash trie (HAMT) mapping keys to values. Every level consumes
+// BITS bits of the hash, so a lookup visits at most 64 / BITS + 1 nodes and
+// on average about log_32(n) of them. Keys whose hashes are equal end up in
+// one collision node below the last level.
+//
+// Copying and the order of copy-on-write and relinking are the same as in
+// ordered_index, so a modification copies at most one node per level and
+// either succeeds or leaves the trie unchanged.
+template <typename K, typename T, typename Hash> class hashed_index
+{
+    static constexpr unsigned BITS = 5;
+    static constexpr unsigned HASH_BITS = 64;
+
+    struct leaf
+    {
+        K key;
+        T value;
+        std::uint64_t hash;
+    };
+
+    // Leaves and children are sorted by the bit of their hash fragment.
+    // Below the last level leaves are unordered and bitmaps are not used.
+    struct trie_node
+    {
+        std::uint32_t leaf_map = 0;
+        std::uint32_t child_map = 0;
+        std::vector<leaf> leaves;
+        std::vector<std::shared_ptr<trie_node>> children;
+    };
+
+    using link_t = std::shared_ptr<trie_node>;
+
+    // Leaves can be moved between and within vectors without throwing, so
+    // a node with a single leaf can be merged into its parent
+    static constexpr bool NOTHROW_MOVE =
+        std::is_nothrow_move_constructible_v<leaf> &&
+        std::is_nothrow_move_assignable_v<leaf>;
+
+  public:
+    std::size_t size() const noexcept
+    {
+        return count;
+    }
+
+    T const *find(K const &key) const
+    {
+        std::uint64_t const hash = Hash{}(key);
+        trie_node const *n = root.get();
+        for (unsigned shift = 0; n && shift < HASH_BITS; shift += BITS)
+        {
+            std::uint32_t const bit = fragment_bit(hash, shift);
+            if (n->leaf_map & bit)
+            {
+                leaf const &found = n->leaves[slot(n->leaf_map, bit)];
+                return found.hash == hash && found.key == key ? &found.value : nullptr;
+            }
+            if (!(n->child_map & bit))
+                return nullptr;
+            n = n->children[slot(n->child_map, bit)].get();
+        }
+
+        if (n)
+            for (leaf const &collision : n->leaves)
+                if (collision.key == key)
+                    return &collision.value;
+        return nullptr;
+    }
+
+    // Value of the key, which can be modified, or nullptr if there is no such
+    // key
+    T *write(K const &key)
+    {
+        std::uint64_t const hash = Hash{}(key);
+        link_t *link = &root;
+        for (unsigned shift = 0; *link && shift < HASH_BITS; shift += BITS)
+        {
+            trie_node &n = own(*link);
+            std::uint32_t const bit = fragment_bit(hash, shift);
+            if (n.leaf_map & bit)
+            {
+                leaf &found = n.leaves[slot(n.leaf_map, bit)];
+                return found.hash == hash && found.key == key ? &found.value : nullptr;
+            }
+            if (!(n.child_map & bit))
+                return nullptr;
+            link = &n.children[slot(n.child_map, bit)];
+        }
+
+        if (*link)
+            for (leaf &collision : own(*link).leaves)
+                if (collision.key == key)
+                    return &collision.value;
+        return nullptr;
+    }
+
+    // Adds a key that is not in the trie and returns its value
+    T &insert(K const &key, T const &value)
+    {
+        leaf created{key, value, Hash{}(key)};
+        if (!root)
+            root = std::make_shared<trie_node>();
+
+        link_t *link = &root;
+        for (unsigned shift = 0;; shift += BITS)
+        {
+            trie_node &n = own(*link);
+            if (shift >= HASH_BITS)
+            {
+                n.leaves.push_back(std::move(created));
+                ++count;
+                return n.leaves.back().value;
+            }
+
+            std::uint32_t const bit = fragment_bit(created.hash, shift);
+            if (n.child_map & bit)
+            {
+                link = &n.children[slot(n.child_map, bit)];
+                continue;
+            }
+
+            if (n.leaf_map & bit)
+            {
+                // The leaf with the same fragment and the new one go to a new
+                // subtrie
+                std::size_t const leaf_slot = slot(n.leaf_map, bit);
+                link_t subtrie =
+                    make_subtrie(n.leaves[leaf_slot], std::move(created), shift + BITS);
+                T &inserted = *find_in(*subtrie, key, shift + BITS);
+                reserve_one(n.children);
+                erase_entry(n.leaves, leaf_slot);
+                n.children.insert(n.children.begin() + slot(n.child_map | bit, bit),
+                                  std::move(subtrie));
+                n.leaf_map &= ~bit;
+                n.child_map |= bit;
+                ++count;
+                return inserted;
+            }
+
+            std::size_t const leaf_slot = slot(n.leaf_map | bit, bit);
+            insert_entry(n.leaves, leaf_slot, std::move(created));
+            n.leaf_map |= bit;
+            ++count;
+            return n.leaves[leaf_slot].value;
+        }
+    }
+
+    // Removes a key that is in the trie
+    void erase(K const &key)
+    {
+        std::uint64_t const hash = Hash{}(key);
+        std::array<link_t *, HASH_BITS / BITS + 2> path;
+        std::size_t length = 0;
+        link_t *link = &root;
+        unsigned shift = 0;
+        while (true)
+        {
+            trie_node &n = own(*link);
+            // A node left with a single leaf is merged into its parent,
+            // which needs room for that leaf
+            if constexpr (NOTHROW_MOVE)
+                reserve_one(n.leaves);
+            path[length++] = link;
+            if (shift >= HASH_BITS)
+                break;
+            std::uint32_t const bit = fragment_bit(hash, shift);
+            if (n.leaf_map & bit)
+                break;
+            link = &n.children[slot(n.child_map, bit)];
+            shift += BITS;
+        }
+
+        trie_node &n = **path[length - 1];
+        if (shift >= HASH_BITS)
+        {
+            std::size_t i = 0;
+            while (!(n.leaves[i].key == key))
+                ++i;
+            erase_entry(n.leaves, i);
+        }
+        else
+        {
+            std::uint32_t const bit = fragment_bit(hash, shift);
+            erase_entry(n.leaves, slot(n.leaf_map, bit));
+            n.leaf_map &= ~bit;
+        }
+        --count;
+
+        for (std::size_t level = length - 1; level > 0; --level)
+        {
+            trie_node &child = **path[level];
+            if (!child.children.empty() || child.leaves.size() > 1)
+                break;
+            if (!child.leaves.empty() && !NOTHROW_MOVE)
+                break;
+
+            trie_node &parent = **path[level - 1];
+            std::uint32_t const bit = fragment_bit(hash, BITS * unsigned(level - 1));
+            if constexpr (NOTHROW_MOVE)
+            {
+                if (!child.leaves.empty())
+                {
+                    std::size_t const leaf_slot = slot(parent.leaf_map | bit, bit);
+                    parent.leaves.insert(parent.leaves.begin() + leaf_slot,
+                                         std::move(child.leaves.front()));
+                    parent.leaf_map |= bit;
+                }
+            }
+            erase_entry(parent.children, slot(parent.child_map, bit));
+            parent.child_map &= ~bit;
+        }
+    }
+
+    void clear() noexcept
+    {
+        root.reset();
+        count = 0;
+    }
+
+  private:
+    link_t root;
+    std::size_t count = 0;
+
+    static std::uint32_t fragment_bit(std::uint64_t hash, unsigned shift) noexcept
+    {
+        return std::uint32_t(1) << ((hash >> shift) & ((1u << BITS) - 1));
+    }
+
+    // Position of the entry with the given bit among entries in the map
+    static std::size_t slot(std::uint32_t map, std::uint32_t bit) noexcept
+    {
+        return std::popcount(map & (bit - 1));
+    }
+
+    template <typename Entry> static void reserve_one(std::vector<Entry> &entries)
+    {
+        if (entries.size() == entries.capacity())
+            entries.reserve(std::max<std::size_t>(4, 2 * entries.size()));
+    }
+
+    // Inserts the entry or, if it throws, leaves the vector unchanged
+    template <typename Entry>
+    static void insert_entry(std::vector<Entry> &entries, std::size_t position,
+                             Entry &&entry)
+    {
+        if constexpr (std::is_nothrow_move_constructible_v<Entry> &&
+                      std::is_nothrow_move_assignable_v<Entry>)
+        {
+            reserve_one(entries);
+            entries.insert(entries.begin() + position, std::move(entry));
+        }
+        else
+        {
+            std::vector<Entry> updated;
+            updated.reserve(entries.size() + 1);
+            updated.insert(updated.end(), entries.begin(), entries.begin() + position);
+            updated.push_back(std::move(entry));
+            updated.insert(updated.end(), entries.begin() + position, entries.end());
+            entries.swap(updated);
+        }
+    }
+
+    // Erases the entry; it throws only if moving entries does, and then
+    // leaves the vector unchanged
+    template <typename Entry>
+    static void erase_entry(std::vector<Entry> &entries, std::size_t position)
+    {
+        if constexpr (std::is_nothrow_move_assignable_v<Entry>)
+            entries.erase(entries.begin() + position);
+        else
+        {
+            std::vector<Entry> updated;
+            updated.reserve(entries.size() - 1);
+            updated.insert(updated.end(), entries.begin(), entries.begin() + position);
+            updated.insert(updated.end(), entries.begin() + position + 1, entries.end());
+            entries.swap(updated);
+        }
+    }
+
+    static T *find_in(trie_node &n, K const &key, unsigned shift)
+    {
+        std::uint64_t const hash = Hash{}(key);
+        for (trie_node *current = &n;; shift += BITS)
+        {
+            if (shift >= HASH_BITS)
+            {
+                for (leaf &collision : current->leaves)
+                    if (collision.key == key)
+                        return &collision.value;
+            }
+            std::uint32_t const bit = fragment_bit(hash, shift);
+            if (current->leaf_map & bit)
+                return &current->leaves[slot(current->leaf_map, bit)].value;
+            current = current->children[slot(current->child_map, bit)].get();
+        }
+    }
+
+    static link_t make_subtrie(leaf const &existing, leaf &&created, unsigned shift)
+    {
+        auto subtrie = std::make_shared<trie_node>();
+        subtrie->leaves.reserve(2);
+        if (shift >= HASH_BITS)
+        {
+            subtrie->leaves.push_back(existing);
+            subtrie->leaves.push_back(std::move(created));
+            return subtrie;
+        }
+
+        std::uint32_t const existing_bit = fragment_bit(existing.hash, shift);
+        std::uint32_t const created_bit = fragment_bit(created.hash, shift);
+        if (existing_bit == created_bit)
+        {
+            subtrie->child_map = existing_bit;
+            subtrie->children.push_back(
+                make_subtrie(existing, std::move(created), shift + BITS));
+        }
+        else
+        {
+            subtrie->leaf_map = existing_bit | created_bit;
+            if (created_bit < existing_bit)
+                subtrie->leaves.push_back(std::move(created));
+            subtrie->leaves.push_back(existing);
+            if (existing_bit < created_bit)
+                subtrie->leaves.push_back(std::move(created));
+        }
+        return subtrie;
+    }
+};
+} // namespace kvfifo_detail
+
+template <typename K>
+concept hashable_key = std::equality_comparable<K> && requires(K const &k) {
+    { std::hash<K>{}(k) } -> std::convertible_to<std::size_t>;
+};
+
+// Index policies of kvfifo. kvfifo_ordered keeps keys in order, which
+// k_begin() and k_end() need; kvfifo_hashed needs only == and std::hash and
+// finds keys in about log_32(n) steps instead of log_2(n) comparisons.
+struct kvfifo_ordered
+{
+    template <typename K> static constexpr bool accepts = std::totally_ordered<K>;
+
+    template <typename K, typename T>
+    using index = kvfifo_detail::ordered_index<K, T>;
+};
+
+struct kvfifo_hashed
+{
+    template <typename K> static constexpr bool accepts = hashable_key<K>;
+
+    template <typename K, typename T>
+    using index = kvfifo_detail::hashed_index<K, T, std::hash<K>>;
+};
+
+#endif
@@ -0,0 +1,225 @@
+// Snapshots read by many threads while the queue they were taken from is
+// modified. A writer applies random operations to a kvfifo and to a model
+// deque, and every few operations publishes a snapshot together with a copy
+// of the model; readers check whole snapshots against their models. Meant to
+// be run under AddressSanitizer or ThreadSanitizer as well. Checks do not
+// depend on NDEBUG.
+//
+// g++ -std=c++20 -O2 -pthread kvfifo_snapshot_test.cc
+// g++ -std=c++20 -O1 -g -pthread -fsanitize=address kvfifo_snapshot_test.cc
+
+#include "kvfifo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+constexpr int KEYS = 17;
+constexpr std::size_t OPERATIONS = 40000;
+constexpr std::size_t READERS = 3;
+
+void check(bool condition, char const *what, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "line %d: %s\n", line, what);
+        exit(1);
+    }
+}
+
+#define CHECK(...) check((__VA_ARGS__), #__VA_ARGS__, __LINE__)
+
+using model_t = std::deque<std::pair<int, std::string>>;
+
+template <typename queue_t> struct published_t
+{
+    std::shared_ptr<queue_t const> snapshot;
+    std::shared_ptr<model_t const> model;
+};
+
+template <typename queue_t> void check_snapshot(published_t<queue_t> const &published)
+{
+    queue_t const &queue = *published.snapshot;
+    model_t const &model = *published.model;
+
+    CHECK(queue.size() == model.size());
+    auto expected = model.begin();
+    for (auto const &[k, v] : queue.items())
+    {
+        CHECK(expected != model.end() && k == expected->first && v == expected->second);
+        ++expected;
+    }
+    CHECK(expected == model.end());
+
+    for (int k = 0; k < KEYS; ++k)
+    {
+        std::size_t count = 0;
+        auto expected_value = model.begin();
+        for (auto const &v : queue.values(k))
+        {
+            while (expected_value->first != k)
+                ++expected_value;
+            CHECK(v == expected_value->second);
+            ++expected_value;
+            ++count;
+        }
+        CHECK(count == queue.count(k));
+    }
+
+    if (!model.empty())
+    {
+        CHECK(queue.front().second == model.front().second);
+        CHECK(queue.back().second == model.back().second);
+    }
+}
+
+// One writer step on both the queue and the model
+template <typename queue_t>
+void modify(queue_t &queue, model_t &model, std::minstd_rand &random, std::size_t &next)
+{
+    int const k = int(random() % KEYS);
+    auto const first_of = [&](int key) {
+        auto it = model.begin();
+        while (it != model.end() && it->first != key)
+            ++it;
+        return it;
+    };
+
+    switch (random() % 8)
+    {
+    case 0:
+    case 1:
+    case 2:
+        queue.push(k, std::to_string(next));
+        model.emplace_back(k, std::to_string(next++));
+        break;
+    case 3:
+        if (!model.empty())
+        {
+            queue.pop();
+            model.pop_front();
+        }
+        break;
+    case 4:
+        if (auto it = first_of(k); it != model.end())
+        {
+            queue.pop(k);
+            model.erase(it);
+        }
+        break;
+    case 5:
+        if (first_of(k) != model.end())
+        {
+            queue.move_to_back(k);
+            model_t moved;
+            std::erase_if(model, [&](auto const &element) {
+                if (element.first != k)
+                    return false;
+                moved.push_back(element);
+                return true;
+            });
+            model.insert(model.end(), moved.begin(), moved.end());
+        }
+        break;
+    case 6:
+    {
+        std::vector<std::pair<int, std::string>> range;
+        for (std::size_t i = random() % 8; i > 0; --i)
+            range.emplace_back(int(random() % KEYS), std::to_string(next++));
+        queue.push_range(range);
+        model.insert(model.end(), range.begin(), range.end());
+        std::size_t const n = std::min<std::size_t>(random() % 8, model.size());
+        queue.pop_n(n);
+        model.erase(model.begin(), model.begin() + n);
+        break;
+    }
+    case 7:
+        // A reference given out by a non-const method makes the queue copy
+        // its elements for the next snapshot
+        if (!model.empty())
+        {
+            queue.front().second += "'";
+            model.front().second += "'";
+        }
+        break;
+    }
+}
+
+template <typename queue_t> void run(char const *name)
+{
+    std::mutex mutex;
+    std::vector<published_t<queue_t>> published;
+    std::atomic<bool> done = false;
+    std::atomic<std::size_t> checked = 0;
+
+    std::vector<std::thread> readers;
+    for (std::size_t r = 0; r < READERS; ++r)
+        readers.emplace_back([&, r] {
+            std::minstd_rand random(r + 1);
+            while (!done.load(std::memory_order_relaxed))
+            {
+                published_t<queue_t> current;
+                {
+                    std::lock_guard lock(mutex);
+                    if (published.empty())
+                        continue;
+                    current = published[random() % published.size()];
+                }
+                check_snapshot(current);
+                checked.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+    {
+        queue_t queue;
+        model_t model;
+        std::minstd_rand random(1);
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < OPERATIONS; ++i)
+        {
+            modify(queue, model, random, next);
+            if (model.size() > 300)
+            {
+                queue.pop_n(100);
+                model.erase(model.begin(), model.begin() + 100);
+            }
+
+            if (i % 50 == 0)
+            {
+                published_t<queue_t> current{queue.snapshot(),
+                                             std::make_shared<model_t const>(model)};
+                std::lock_guard lock(mutex);
+                if (published.size() == 8)
+                    published.erase(published.begin());
+                published.push_back(std::move(current));
+            }
+        }
+        // The queue is destroyed while readers may still be reading its
+        // snapshots
+    }
+
+    while (checked.load(std::memory_order_relaxed) < READERS)
+        std::this_thread::yield();
+    done = true;
+    for (auto &reader : readers)
+        reader.join();
+    printf("%-16s %zu snapshots checked\n", name, checked.load());
+}
+} // namespace
+
+int main()
+{
+    run<kvfifo<int, std::string>>("kvfifo");
+    run<unordered_kvfifo<int, std::string>>("unordered_kvfifo");
+}
@@ -0,0 +1,731 @@
+// Tests of kvfifo and unordered_kvfifo against a model deque. Allocations
+// can be made to fail, to check that a failed operation leaves the queue
+// unchanged. Checks do not depend on NDEBUG.
+//
+// g++ -std=c++20 -O2 kvfifo_test.cc
+// g++ -std=c++20 -O1 -g -fsanitize=address,undefined kvfifo_test.cc
+
+#include "kvfifo.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <new>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Number of allocations that succeed before operator new throws, or -1 if
+// all of them do
+static long allocations_left = -1;
+
+// All replaced allocation functions use malloc and free. The deallocation
+// functions are not inlined, so that the compiler does not see free() of a
+// pointer that came from operator new.
+void *operator new(std::size_t size)
+{
+    if (allocations_left == 0)
+        throw std::bad_alloc();
+    if (allocations_left > 0)
+        --allocations_left;
+    if (void *allocated = std::malloc(size != 0 ? size : 1))
+        return allocated;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+[[gnu::noinline]] void operator delete(void *allocated) noexcept
+{
+    std::free(allocated);
+}
+
+[[gnu::noinline]] void operator delete[](void *allocated) noexcept
+{
+    std::free(allocated);
+}
+
+void operator delete(void *allocated, std::size_t) noexcept
+{
+    operator delete(allocated);
+}
+
+void operator delete[](void *allocated, std::size_t) noexcept
+{
+    operator delete[](allocated);
+}
+
+// Key of unordered_kvfifo whose hashes differ only in the highest bits, and
+// are equal for keys equal modulo 4
+struct colliding_key
+{
+    int k = 0;
+
+    colliding_key() = default;
+
+    colliding_key(int k) : k(k)
+    {}
+
+    bool operator==(colliding_key const &) const = default;
+};
+
+template <> struct std::hash<colliding_key>
+{
+    std::size_t operator()(colliding_key key) const noexcept
+    {
+        return std::size_t(key.k % 4) << 60 | 5;
+    }
+};
+
+namespace
+{
+void check(bool condition, char const *what, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "line %d: %s\n", line, what);
+        exit(1);
+    }
+}
+
+#define CHECK(...) check((__VA_ARGS__), #__VA_ARGS__, __LINE__)
+
+template <typename Exception, typename Operation> bool throws(Operation operation)
+{
+    try
+    {
+        operation();
+    }
+    catch (Exception const &)
+    {
+        return true;
+    }
+    return false;
+}
+
+constexpr int KEYS = 13;
+
+using model_t = std::deque<std::pair<int, std::string>>;
+
+int key_value(int k)
+{
+    return k;
+}
+
+int key_value(colliding_key key)
+{
+    return key.k;
+}
+
+// Elements of the queue in order, read from a copy of it
+template <typename queue_t> model_t contents(queue_t queue)
+{
+    model_t result;
+    while (!queue.empty())
+    {
+        auto const front = std::as_const(queue).front();
+        result.emplace_back(key_value(front.first), front.second);
+        queue.pop();
+    }
+    return result;
+}
+
+template <typename queue_t> void check_same(queue_t const &queue, model_t const &model)
+{
+    CHECK(queue.size() == model.size());
+    CHECK(queue.empty() == model.empty());
+    CHECK(contents(queue) == model);
+    CHECK(std::ranges::size(queue.items()) == model.size());
+    auto expected = model.begin();
+    for (auto const &[k, v] : queue.items())
+    {
+        CHECK(key_value(k) == expected->first && v == expected->second);
+        ++expected;
+    }
+    if (!model.empty())
+    {
+        CHECK(queue.front().first == model.front().first);
+        CHECK(queue.back().second == model.back().second);
+    }
+
+    for (int k = 0; k < KEYS; ++k)
+    {
+        std::vector<std::string> values;
+        for (auto const &[key, value] : model)
+            if (key == k)
+                values.push_back(value);
+        CHECK(queue.count(k) == values.size());
+        CHECK(std::ranges::size(queue.values(k)) == values.size());
+        CHECK(std::ranges::equal(queue.values(k), values));
+        if (!values.empty())
+        {
+            CHECK(queue.first(k).second == values.front());
+            CHECK(queue.last(k).second == values.back());
+        }
+    }
+
+    if constexpr (requires { queue.k_begin(); })
+    {
+        int previous = -1;
+        std::size_t keys = 0;
+        for (auto it = queue.k_begin(); it != queue.k_end(); ++it, ++keys)
+        {
+            CHECK(previous < *it && queue.count(*it) != 0);
+            previous = *it;
+        }
+        std::size_t model_keys = 0;
+        for (int k = 0; k < KEYS; ++k)
+            model_keys += queue.count(k) != 0;
+        CHECK(keys == model_keys);
+    }
+}
+
+std::size_t model_count(model_t const &model, int k)
+{
+    std::size_t count = 0;
+    for (auto const &element : model)
+        count += element.first == k;
+    return count;
+}
+
+bool model_has(model_t const &model, int k)
+{
+    return model_count(model, k) != 0;
+}
+
+void model_pop(model_t &model, int k)
+{
+    for (auto it = model.begin(); it != model.end(); ++it)
+        if (it->first == k)
+        {
+            model.erase(it);
+            return;
+        }
+}
+
+void model_move_to_back(model_t &model, int k)
+{
+    model_t moved;
+    std::erase_if(model, [&](auto const &element) {
+        if (element.first != k)
+            return false;
+        moved.push_back(element);
+        return true;
+    });
+    model.insert(model.end(), moved.begin(), moved.end());
+}
+
+// Calls operation(queue) with 0, 1, 2, ... allocations allowed until it
+// succeeds. Every time it fails, the queue must be left unchanged.
+template <typename queue_t, typename Operation>
+void check_strong(queue_t &queue, Operation operation)
+{
+    model_t const before = contents(queue);
+    for (long limit = 0;; ++limit)
+    {
+        allocations_left = limit;
+        try
+        {
+            operation(queue);
+            allocations_left = -1;
+            return;
+        }
+        catch (std::bad_alloc const &)
+        {
+            allocations_left = -1;
+            check_same(queue, before);
+        }
+    }
+}
+
+// One random operation on both the queue and the model; with fail set,
+// it is first tried with too few allocations
+template <typename queue_t>
+void random_step(queue_t &queue, model_t &model, std::minstd_rand &random, bool fail,
+                 std::size_t step)
+{
+    int const k = int(random() % KEYS);
+    std::string const value = std::to_string(step);
+    auto const apply = [&](auto operation) {
+        if (fail)
+            check_strong(queue, operation);
+        else
+            operation(queue);
+    };
+
+    switch (random() % 12)
+    {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+        apply([&](queue_t &q) { q.push(k, value); });
+        model.emplace_back(k, value);
+        break;
+    case 4:
+        if (!model.empty())
+        {
+            apply([](queue_t &q) { q.pop(); });
+            model.pop_front();
+        }
+        break;
+    case 5:
+        if (model_has(model, k))
+        {
+            apply([&](queue_t &q) { q.pop(k); });
+            model_pop(model, k);
+        }
+        break;
+    case 6:
+        if (model_has(model, k))
+        {
+            apply([&](queue_t &q) { q.move_to_back(k); });
+            model_move_to_back(model, k);
+        }
+        break;
+    case 7:
+        if (model_has(model, k))
+        {
+            apply([&](queue_t &q) { q.last(k).second = value; });
+            for (auto it = model.rbegin(); it != model.rend(); ++it)
+                if (it->first == k)
+                {
+                    it->second = value;
+                    break;
+                }
+        }
+        else if (!model.empty())
+        {
+            apply([&](queue_t &q) { q.front().second = value; });
+            model.front().second = value;
+        }
+        break;
+    case 8:
+        if (random() % 1024 == 0)
+        {
+            queue.clear();
+            model.clear();
+        }
+        break;
+    case 9:
+    {
+        std::vector<std::pair<int, std::string>> range;
+        for (std::size_t i = random() % 8; i > 0; --i)
+            range.emplace_back(int(random() % KEYS), value + "." + std::to_string(i));
+        apply([&](queue_t &q) { q.push_range(range); });
+        model.insert(model.end(), range.begin(), range.end());
+        break;
+    }
+    case 10:
+    {
+        std::size_t const n = std::min<std::size_t>(random() % 8, model.size());
+        apply([&](queue_t &q) { q.pop_n(n); });
+        model.erase(model.begin(), model.begin() + n);
+        break;
+    }
+    case 11:
+    {
+        std::size_t const n = std::min<std::size_t>(random() % 3, model_count(model, k));
+        apply([&](queue_t &q) { q.pop_n(k, n); });
+        for (std::size_t i = 0; i < n; ++i)
+            model_pop(model, k);
+        break;
+    }
+    }
+}
+
+// The queue grows to a couple of thousand elements, over many chunks of
+// the arena, and nodes of removed elements are reused
+template <typename queue_t> void test_random(unsigned seed)
+{
+    std::minstd_rand random(seed);
+    queue_t queue;
+    model_t model;
+    for (std::size_t step = 0; step < 20000; ++step)
+    {
+        random_step(queue, model, random, false, step);
+        if (step % 101 == 0)
+            check_same(queue, model);
+    }
+    check_same(queue, model);
+
+    while (!model.empty())
+    {
+        queue.pop();
+        model.pop_front();
+    }
+    check_same(queue, model);
+}
+
+// Every operation is first made to fail at each of its allocations
+template <typename queue_t> void test_strong_guarantee(unsigned seed)
+{
+    std::minstd_rand random(seed);
+    queue_t queue;
+    model_t model;
+    for (std::size_t step = 0; step < 1500; ++step)
+    {
+        random_step(queue, model, random, true, step);
+        if (step % 37 == 0)
+            check_same(queue, model);
+    }
+    check_same(queue, model);
+}
+
+// Copies share elements until one of them changes. Every operation on one
+// copy, also one that fails for lack of memory, leaves the others unchanged.
+template <typename queue_t> void test_sharing(unsigned seed)
+{
+    constexpr std::size_t QUEUES = 4;
+
+    std::minstd_rand random(seed);
+    std::vector<queue_t> queues(QUEUES);
+    std::vector<model_t> models(QUEUES);
+    for (std::size_t step = 0; step < 6000; ++step)
+    {
+        std::size_t const q = random() % QUEUES;
+        if (random() % 8 == 0)
+        {
+            std::size_t const from = random() % QUEUES;
+            queues[q] = queues[from];
+            models[q] = models[from];
+        }
+        else
+            random_step(queues[q], models[q], random, step % 8 == 0, step);
+
+        if (step % 53 == 0)
+            for (std::size_t i = 0; i < QUEUES; ++i)
+                check_same(queues[i], models[i]);
+    }
+    for (std::size_t i = 0; i < QUEUES; ++i)
+        check_same(queues[i], models[i]);
+}
+
+// A reference given out by a non-const method may still be used to change
+// its element, so copies made while it is valid do not share elements
+template <typename queue_t> void test_references()
+{
+    queue_t queue;
+    queue.push(1, "a");
+    queue.push(2, "b");
+
+    std::string &front = queue.front().second;
+    std::string &last = queue.last(2).second;
+    queue_t const copy = queue;
+    auto const snapshot = queue.snapshot();
+    front = "c";
+    last = "d";
+    check_same(queue, {{1, "c"}, {2, "d"}});
+    check_same(copy, {{1, "a"}, {2, "b"}});
+    check_same(*snapshot, {{1, "a"}, {2, "b"}});
+
+    // Const access gives out no such references
+    queue_t shared = copy;
+    CHECK(&std::as_const(shared).front().second == &copy.front().second);
+    shared.push(3, "e");
+    check_same(copy, {{1, "a"}, {2, "b"}});
+    check_same(shared, {{1, "a"}, {2, "b"}, {3, "e"}});
+}
+
+// Value that counts its copies
+struct counted
+{
+    static inline std::size_t copies = 0;
+
+    std::string s;
+
+    counted(std::string s) : s(std::move(s))
+    {}
+
+    counted(counted const &other) : s(other.s)
+    {
+        ++copies;
+    }
+
+    counted(counted &&) noexcept = default;
+};
+
+// Value that can be neither copied nor moved
+struct pinned
+{
+    int x;
+
+    pinned(int x, int y) : x(x + y)
+    {}
+
+    pinned(pinned const &) = delete;
+};
+
+template <template <typename, typename> typename kvfifo_t> void test_move_only()
+{
+    using queue_t = kvfifo_t<int, std::unique_ptr<int>>;
+    static_assert(!std::is_copy_constructible_v<queue_t>);
+    static_assert(std::is_nothrow_move_constructible_v<queue_t>);
+
+    queue_t queue;
+    auto pushed = std::make_unique<int>(1);
+    queue.push(1, std::move(pushed));
+    CHECK(!pushed);
+    int const key = 2;
+    queue.push(key, std::make_unique<int>(2));
+    queue.emplace(1, new int(3));
+    CHECK(queue.size() == 3 && queue.count(1) == 2);
+    CHECK(*queue.front().second == 1 && *queue.back().second == 3);
+
+    // A failed push leaves the value where it was
+    pushed = std::make_unique<int>(4);
+    for (long limit = 0;; ++limit)
+    {
+        allocations_left = limit;
+        try
+        {
+            queue.push(3, std::move(pushed));
+            allocations_left = -1;
+            break;
+        }
+        catch (std::bad_alloc const &)
+        {
+            allocations_left = -1;
+            CHECK(pushed && *pushed == 4 && queue.size() == 3);
+        }
+    }
+    CHECK(!pushed && *queue.back().second == 4);
+
+    queue_t moved = std::move(queue);
+    queue = std::move(moved);
+    std::unique_ptr<int> taken = std::move(queue.first(1).second);
+    CHECK(*taken == 1);
+    queue.pop(1);
+    queue.move_to_back(2);
+    queue.pop();
+    CHECK(*queue.front().second == 4 && *queue.back().second == 2);
+
+    for (int i = 0; i < 1000; ++i)
+        queue.push(i % 10, std::make_unique<int>(i));
+    while (queue.size() > 2)
+        queue.pop(int(queue.size() % 10));
+    queue.clear();
+    CHECK(queue.empty());
+}
+
+// Rvalue keys and values are moved into the queue, and only a copy that
+// changes copies the values it shares
+template <template <typename, typename> typename kvfifo_t> void test_copies()
+{
+    counted::copies = 0;
+    kvfifo_t<std::string, counted> queue;
+    queue.push(std::string("a"), counted("x"));
+    queue.emplace("b", "y");
+    std::string const key = "c";
+    queue.push(key, counted("z"));
+    CHECK(counted::copies == 0);
+
+    auto copy = queue;
+    CHECK(counted::copies == 0);
+    copy.push("d", counted("w"));
+    CHECK(queue.size() == 3 && copy.size() == 4);
+    CHECK(std::as_const(queue).back().second.s == "z");
+    CHECK(std::as_const(copy).back().second.s == "w");
+
+    kvfifo_t<int, pinned> pinned_values;
+    pinned_values.emplace(1, 2, 3);
+    CHECK(pinned_values.front().second.x == 5);
+}
+
+// Batches that can not be done leave the queue unchanged, and ranges of any
+// kind can be pushed
+template <template <typename, typename> typename kvfifo_t> void test_batches()
+{
+    kvfifo_t<int, std::string> queue;
+    queue.push_range(std::views::iota(0, 10) | std::views::transform([](int i) {
+                         return std::pair<int, std::string>(i % 3, std::to_string(i));
+                     }));
+    model_t model;
+    for (int i = 0; i < 10; ++i)
+        model.emplace_back(i % 3, std::to_string(i));
+    check_same(queue, model);
+
+    CHECK(throws<std::invalid_argument>([&] { queue.pop_n(11); }));
+    CHECK(throws<std::invalid_argument>([&] { queue.pop_n(1, 4); }));
+    CHECK(throws<std::invalid_argument>([&] { queue.pop_n(5, 1); }));
+    check_same(queue, model);
+
+    queue.pop_n(0);
+    queue.pop_n(5, 0);
+    queue.push_range(std::vector<std::pair<int, std::string>>());
+    check_same(queue, model);
+
+    queue.pop_n(1, 3);
+    queue.pop_n(4);
+    check_same(queue, {{0, "6"}, {2, "8"}, {0, "9"}});
+    queue.pop_n(3);
+    check_same(queue, {});
+
+    std::vector<std::pair<int, std::unique_ptr<int>>> values;
+    for (int i = 0; i < 10; ++i)
+        values.emplace_back(i % 3, std::make_unique<int>(i));
+    kvfifo_t<int, std::unique_ptr<int>> move_only;
+    move_only.push_range(std::ranges::subrange(std::make_move_iterator(values.begin()),
+                                               std::make_move_iterator(values.end())));
+    CHECK(move_only.size() == 10 && *move_only.last(0).second == 9 && !values[0].second);
+    move_only.pop_n(0, 3);
+    CHECK(move_only.count(0) == 1);
+    move_only.pop_n(4);
+    CHECK(move_only.size() == 3 && *move_only.front().second == 7);
+}
+
+template <template <typename, typename> typename kvfifo_t> void test_views()
+{
+    using queue_t = kvfifo_t<int, std::string>;
+    using items_t = decltype(std::declval<queue_t const &>().items());
+    using values_t = decltype(std::declval<queue_t const &>().values(0));
+    static_assert(std::ranges::view<items_t> && std::ranges::forward_range<items_t> &&
+                  std::ranges::sized_range<items_t>);
+    static_assert(std::ranges::view<values_t> && std::ranges::forward_range<values_t> &&
+                  std::ranges::sized_range<values_t>);
+
+    queue_t queue;
+    CHECK(queue.items().empty() && queue.values(1).empty());
+    for (int i = 0; i < 300; ++i)
+        queue.push(i % 7, std::to_string(i));
+    queue.move_to_back(3);
+
+    auto const values = queue.values(3);
+    CHECK(*values.begin() == "3" && std::ranges::find(values, "297") != values.end());
+    CHECK(std::ranges::distance(values.begin(), values.end()) == 43);
+
+    // Iterators are multi-pass and compare equal at equal positions
+    auto const items = queue.items();
+    auto it = items.begin();
+    auto const second = std::next(it);
+    CHECK(it++ != second && it == second && it->second == "1");
+
+    // Views give out const references only, so a copy still shares elements
+    queue_t const copy = queue;
+    CHECK(&(*copy.items().begin()).second == &(*queue.items().begin()).second);
+
+    kvfifo_t<int, std::unique_ptr<int>> move_only;
+    move_only.push(1, std::make_unique<int>(5));
+    for (auto const &[k, v] : move_only.items())
+        CHECK(k == 1 && *v == 5);
+    for (auto const &v : move_only.values(1))
+        CHECK(*v == 5);
+
+    queue_t moved = std::move(queue);
+    CHECK(queue.items().empty() && queue.values(1).empty());
+}
+
+// k_iterator goes over keys in both directions, and stays valid when other
+// keys are added or removed
+void test_key_iterator()
+{
+    kvfifo<int, int> queue;
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue.push(i * 7919 % 1000 * 2, i);
+        keys.push_back(i * 2);
+    }
+
+    std::vector<int> forward(queue.k_begin(), queue.k_end());
+    CHECK(forward == keys);
+    std::vector<int> backward;
+    for (auto it = queue.k_end(); it != queue.k_begin();)
+        backward.push_back(*--it);
+    CHECK(std::ranges::equal(backward, keys | std::views::reverse));
+
+    auto it = queue.k_begin();
+    std::advance(it, 500);
+    CHECK(*it == 1000);
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.push(1001 + 2 * i, i);
+        queue.pop(998 - 2 * i);
+    }
+    CHECK(*it++ == 1000 && *it == 1001 && *--it == 1000 && *--it == 798);
+    CHECK(*std::prev(queue.k_end()) == 1998);
+
+    // The nodes on the path of an iterator, including the one of its key,
+    // are shared with a copy, the queue copies them when it is modified, and
+    // then the copy, the last owner of the old nodes, is destroyed
+    kvfifo<int, int> shared;
+    for (int k = 0; k < 64; ++k)
+        shared.push(k, k);
+    for (int pos : {10, 11, 0, 63, 64})
+    {
+        auto shared_it = std::next(shared.k_begin(), 10);
+        {
+            auto copy = shared;
+            copy.push(1000, 0);
+            shared.push(pos, 1);
+        }
+        CHECK(*++shared_it == 11 && *--shared_it == 10 && *--shared_it == 9);
+        if (pos == 64)
+            shared.pop(64);
+    }
+    CHECK(std::ranges::equal(std::ranges::subrange(shared.k_begin(), shared.k_end()),
+                             std::views::iota(0, 64)));
+}
+
+template <typename queue_t> void test_errors()
+{
+    queue_t queue;
+    CHECK(throws<std::invalid_argument>([&] { queue.pop(); }));
+    CHECK(throws<std::invalid_argument>([&] { queue.pop(1); }));
+    CHECK(throws<std::invalid_argument>([&] { queue.move_to_back(1); }));
+    CHECK(throws<std::invalid_argument>([&] { queue.front(); }));
+    CHECK(throws<std::invalid_argument>([&] { std::as_const(queue).back(); }));
+
+    queue.push(1, "a");
+    CHECK(throws<std::invalid_argument>([&] { queue.first(2); }));
+    CHECK(throws<std::invalid_argument>([&] { std::as_const(queue).last(2); }));
+    CHECK(throws<std::invalid_argument>([&] { queue.pop(2); }));
+    check_same(queue, {{1, "a"}});
+
+    queue_t moved = std::move(queue);
+    check_same(moved, {{1, "a"}});
+    check_same(queue, {});
+}
+} // namespace
+
+int main()
+{
+    for (unsigned seed = 1; seed <= 4; ++seed)
+    {
+        test_random<kvfifo<int, std::string>>(seed);
+        test_strong_guarantee<kvfifo<int, std::string>>(seed);
+        test_sharing<kvfifo<int, std::string>>(seed);
+    }
+    test_references<kvfifo<int, std::string>>();
+    test_key_iterator();
+    test_errors<kvfifo<int, std::string>>();
+
+    for (unsigned seed = 1; seed <= 4; ++seed)
+    {
+        test_random<unordered_kvfifo<int, std::string>>(seed);
+        test_strong_guarantee<unordered_kvfifo<int, std::string>>(seed);
+        test_sharing<unordered_kvfifo<int, std::string>>(seed);
+        test_random<unordered_kvfifo<colliding_key, std::string>>(seed);
+        test_strong_guarantee<unordered_kvfifo<colliding_key, std::string>>(seed);
+    }
+    test_references<unordered_kvfifo<int, std::string>>();
+    test_errors<unordered_kvfifo<int, std::string>>();
+
+    test_move_only<kvfifo>();
+    test_move_only<unordered_kvfifo>();
+    test_copies<kvfifo>();
+    test_copies<unordered_kvfifo>();
+    test_batches<kvfifo>();
+    test_batches<unordered_kvfifo>();
+    test_views<kvfifo>();
+    test_views<unordered_kvfifo>();
+}
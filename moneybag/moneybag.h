@@ -2,223 +2,426 @@
 #define MONEYBAG_H
 
 #include <iostream>
-#include <sstream>
-#include <iomanip>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <algorithm>
+#include <array>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <stdexcept>
+#include <optional>
+
+// Nazwy monet w kolejnosci od najcenniejszej
+struct MoneybagCoins {
+    static constexpr std::string_view singular[] = { "livr", "solidus", "denier" };
+    static constexpr std::string_view plural[] = { "livres", "soliduses", "deniers" };
+};
+
+namespace purse_detail {
+    using value_t = unsigned __int128;
+
+    // Ile najmniejszych monet warta jest moneta kazdego rodzaju,
+    // np. dla przelicznikow 20 i 12: { 240, 12, 1 }
+    template <std::uint64_t... Ratios>
+    constexpr std::array<value_t, sizeof...(Ratios) + 1> factors() {
+        std::array<value_t, sizeof...(Ratios) + 1> result{};
+        const std::uint64_t ratios[] = { Ratios..., 1 };
+        result[sizeof...(Ratios)] = 1;
+        for (std::size_t i = sizeof...(Ratios); i-- > 0;)
+            if (__builtin_mul_overflow(result[i + 1], ratios[i], &result[i]))
+                throw std::out_of_range("ratios are too large");
+        return result;
+    }
+
+    // Wartosc pelnej sakiewki musi miescic sie w 128 bitach
+    template <std::size_t N>
+    constexpr bool value_fits(const std::array<value_t, N>& factors) {
+        value_t total = 0;
+        for (value_t factor : factors) {
+            value_t coins_value;
+            if (__builtin_mul_overflow(factor, value_t(UINT64_MAX), &coins_value) ||
+                __builtin_add_overflow(total, coins_value, &total))
+                return false;
+        }
+        return true;
+    }
+
+    // Najdluzszy tekst: nawiasy, separatory ", " i liczby 20-cyfrowe z najdluzsza nazwa
+    template <typename Coins>
+    constexpr std::size_t max_chars() {
+        std::size_t result = 2;
+        for (std::size_t i = 0; i < std::size(Coins::singular); ++i)
+            result += 20 + 1 + std::max(Coins::singular[i].size(), Coins::plural[i].size()) +
+                (i == 0 ? 0 : 2);
+        return result;
+    }
+}
 
-class Moneybag {
+// Sakiewka z dowolnym systemem monet. Ratios to przeliczniki miedzy kolejnymi
+// monetami (od najcenniejszej), a Coins dostarcza ich nazwy. Wszystkie
+// wspolczynniki, ograniczenia i rozmiary tekstu liczone sa w czasie kompilacji.
+template <typename Coins, std::uint64_t... Ratios>
+    requires ((Ratios > 0) && ...) &&
+        (std::size(Coins::singular) == sizeof...(Ratios) + 1) &&
+        (std::size(Coins::plural) == sizeof...(Ratios) + 1)
+class Purse {
 public:
     using coin_number_t = std::uint64_t;
+    using coins_t = Coins;
 
-    constexpr Moneybag(coin_number_t livre, coin_number_t solidus, coin_number_t denier) : 
-            livre{ livre },
-            solidus{ solidus },
-            denier{ denier } {}
+    static constexpr std::size_t COINS = sizeof...(Ratios) + 1;
+    static constexpr std::array<purse_detail::value_t, COINS> FACTORS =
+        purse_detail::factors<Ratios...>();
+    static constexpr std::size_t MAX_CHARS = purse_detail::max_chars<Coins>();
 
-    constexpr Moneybag(const Moneybag& m_bag) :
-        livre{ m_bag.livre},
-        solidus{ m_bag.solidus},
-        denier{ m_bag.denier} {}
+    static_assert(purse_detail::value_fits(FACTORS), "purse value must fit in 128 bits");
 
-    constexpr coin_number_t livre_number() const {
-        return livre;
+    template <std::convertible_to<coin_number_t>... Numbers>
+        requires (sizeof...(Numbers) == COINS)
+    constexpr explicit(sizeof...(Numbers) == 1) Purse(Numbers... numbers) :
+        coins{ coin_number_t(numbers)... } {}
+
+    constexpr explicit Purse(const std::array<coin_number_t, COINS>& coins) :
+        coins{ coins } {}
+
+    constexpr Purse(const Purse& purse) = default;
+
+    constexpr Purse& operator=(const Purse& purse) = default;
+
+    constexpr coin_number_t coin_number(std::size_t i) const {
+        return coins[i];
     }
 
-    constexpr coin_number_t solidus_number() const {
-        return solidus;
+    constexpr coin_number_t livre_number() const requires std::same_as<Coins, MoneybagCoins> {
+        return coins[0];
     }
 
-    constexpr coin_number_t denier_number() const {
-        return denier;
+    constexpr coin_number_t solidus_number() const requires std::same_as<Coins, MoneybagCoins> {
+        return coins[1];
     }
 
-    constexpr Moneybag& operator=(const Moneybag& m_bag) {
-        livre = m_bag.livre;
-        solidus = m_bag.solidus;
-        denier = m_bag.denier;
+    constexpr coin_number_t denier_number() const requires std::same_as<Coins, MoneybagCoins> {
+        return coins[2];
+    }
 
-        return *this;
+    // Wersje operacji bez wyjatkow: zwracaja pusty optional przy przepelnieniu
+    constexpr std::optional<Purse> checked_add(const Purse& purse) const noexcept {
+        Purse result = *this;
+        bool overflow = false;
+        for (std::size_t i = 0; i < COINS; ++i)
+            overflow |= __builtin_add_overflow(coins[i], purse.coins[i], &result.coins[i]);
+        if (overflow) return std::nullopt;
+        return result;
     }
 
-    constexpr Moneybag& operator+=(const Moneybag& m_bag) {
-        if (UINT64_MAX - m_bag.livre < livre || UINT64_MAX - m_bag.solidus < solidus ||
-            UINT64_MAX - m_bag.denier < denier) throw std::out_of_range("value can not be too large");
+    constexpr std::optional<Purse> checked_sub(const Purse& purse) const noexcept {
+        Purse result = *this;
+        bool overflow = false;
+        for (std::size_t i = 0; i < COINS; ++i)
+            overflow |= __builtin_sub_overflow(coins[i], purse.coins[i], &result.coins[i]);
+        if (overflow) return std::nullopt;
+        return result;
+    }
 
-        livre += m_bag.livre;
-        solidus += m_bag.solidus;
-        denier += m_bag.denier;
+    constexpr std::optional<Purse> checked_mul(const coin_number_t num) const noexcept {
+        Purse result = *this;
+        bool overflow = false;
+        for (std::size_t i = 0; i < COINS; ++i)
+            overflow |= __builtin_mul_overflow(coins[i], num, &result.coins[i]);
+        if (overflow) return std::nullopt;
+        return result;
+    }
 
-        return *this;
+    constexpr Purse& operator+=(const Purse& purse) {
+        std::optional<Purse> result = checked_add(purse);
+        if (!result) throw std::out_of_range("value can not be too large");
+
+        return *this = *result;
     }
 
-    constexpr Moneybag operator+(const Moneybag& m_bag) {
-        Moneybag to_return = *this;
-        to_return += m_bag;
+    constexpr Purse operator+(const Purse& purse) {
+        Purse to_return = *this;
+        to_return += purse;
 
         return to_return;
     }
 
-    constexpr Moneybag& operator-=(const Moneybag& m_bag) {
-        if (livre < m_bag.livre || solidus < m_bag.solidus ||
-            denier < m_bag.denier) throw std::out_of_range("value can not be negative");
-            
-        livre -= m_bag.livre;
-        solidus -= m_bag.solidus;
-        denier -= m_bag.denier;
+    constexpr Purse& operator-=(const Purse& purse) {
+        std::optional<Purse> result = checked_sub(purse);
+        if (!result) throw std::out_of_range("value can not be negative");
 
-        return *this;
+        return *this = *result;
     }
 
-    constexpr Moneybag operator-(const Moneybag& m_bag) {
-        Moneybag to_return = *this;
-        to_return -= m_bag;
+    constexpr Purse operator-(const Purse& purse) {
+        Purse to_return = *this;
+        to_return -= purse;
 
         return to_return;
     }
 
-    constexpr Moneybag& operator*=(const Moneybag::coin_number_t num) {
-        Moneybag::coin_number_t max_available = Moneybag::coin_number_t(UINT64_MAX) / num;
-        if (max_available <  std::max({livre, solidus, denier})) 
-            throw std::out_of_range("value can not be too large");
-        livre *= num;
-        solidus *= num;
-        denier *= num;
+    constexpr Purse& operator*=(const coin_number_t num) {
+        std::optional<Purse> result = checked_mul(num);
+        if (!result) throw std::out_of_range("value can not be too large");
 
-        return *this;
+        return *this = *result;
     }
 
-    constexpr Moneybag operator*(const Moneybag::coin_number_t num) {
-        Moneybag to_return = *this;
+    constexpr Purse operator*(const coin_number_t num) {
+        Purse to_return = *this;
         to_return *= num;
 
         return to_return;
     }
 
-    constexpr std::partial_ordering operator<=>(const Moneybag& m_bag) const {
-        if (livre == m_bag.livre && solidus == m_bag.solidus &&
-            denier == m_bag.denier) return std::partial_ordering::equivalent;
-        else if (livre >= m_bag.livre && solidus >= m_bag.solidus &&
-            denier >= m_bag.denier) return std::partial_ordering::greater;
-        else if (livre <= m_bag.livre && solidus <= m_bag.solidus &&
-            denier <= m_bag.denier) return std::partial_ordering::less;
+    constexpr std::partial_ordering operator<=>(const Purse& purse) const {
+        bool greater_or_equal = true;
+        bool less_or_equal = true;
+        for (std::size_t i = 0; i < COINS; ++i) {
+            greater_or_equal &= coins[i] >= purse.coins[i];
+            less_or_equal &= coins[i] <= purse.coins[i];
+        }
+
+        if (greater_or_equal && less_or_equal) return std::partial_ordering::equivalent;
+        else if (greater_or_equal) return std::partial_ordering::greater;
+        else if (less_or_equal) return std::partial_ordering::less;
         else return std::partial_ordering::unordered;
     }
 
-    constexpr bool operator==(const Moneybag& m_bag) const {
-        return livre == m_bag.livre && solidus == m_bag.solidus &&
-            denier == m_bag.denier;
+    constexpr bool operator==(const Purse& purse) const {
+        return coins == purse.coins;
     }
 
     constexpr explicit operator bool() const {
-        if (livre == 0 && solidus == 0 && denier == 0) return false;
-        else return true;
+        return std::any_of(coins.begin(), coins.end(),
+            [](coin_number_t coin) { return coin != 0; });
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const Moneybag& m_bag) {
-        os << "("
-            << m_bag.livre;
-        if (m_bag.livre == 1) os << " livr, ";
-        else os << " livres, ";
-        os << m_bag.solidus;
-        if (m_bag.solidus == 1) os << " solidus, ";
-        else os << " soliduses, ";
-        os << m_bag.denier;
-        if (m_bag.denier == 1) os << " denier)";
-        else os << " deniers)";
-        return os;
+    friend std::ostream& operator<<(std::ostream& os, const Purse& purse) {
+        os << "(";
+        for (std::size_t i = 0; i < COINS; ++i) {
+            if (i != 0) os << ", ";
+            os << purse.coins[i] << " ";
+            if (purse.coins[i] == 1) os << Coins::singular[i];
+            else os << Coins::plural[i];
+        }
+        return os << ")";
     }
 
 private:
-    coin_number_t livre;
-    coin_number_t solidus;
-    coin_number_t denier;
+    std::array<coin_number_t, COINS> coins;
 };
 
-inline Moneybag operator*(Moneybag::coin_number_t x, Moneybag m_bag) {
-    return m_bag * x;
+template <typename Coins, std::uint64_t... Ratios>
+constexpr Purse<Coins, Ratios...> operator*(std::uint64_t x, Purse<Coins, Ratios...> purse) {
+    return purse * x;
 }
 
+using Moneybag = Purse<MoneybagCoins, 20, 12>;
+
 constexpr Moneybag Livre(1, 0, 0);
 constexpr Moneybag Solidus(0, 1, 0);
 constexpr Moneybag Denier(0, 0, 1);
 
 class Value {
 public:
-    constexpr Value(const Moneybag& m_bag) : 
-        Value{m_bag.livre_number()} {
-        *this *= 20;
-        *this += Value(m_bag.solidus_number());
-        *this *= 12;
-        *this += Value(m_bag.denier_number());
+    using value_t = unsigned __int128;
+
+    // Wartosc miesci sie w 128 bitach, wiec wystarcza 39 cyfr
+    static constexpr std::size_t MAX_DIGITS = 39;
+
+    // Wartosc wyrazona w najmniejszych monetach danego systemu
+    template <typename Coins, std::uint64_t... Ratios>
+    constexpr Value(const Purse<Coins, Ratios...>& purse) :
+        value{ 0 } {
+        for (std::size_t i = 0; i < Purse<Coins, Ratios...>::COINS; ++i)
+            value += Purse<Coins, Ratios...>::FACTORS[i] * purse.coin_number(i);
+    }
+
+    constexpr Value(const Moneybag::coin_number_t num) :
+        value{ num } {}
+
+    // Wartosc zapisana wprost jako liczba najmniejszych monet
+    static constexpr Value from_raw(value_t raw) {
+        Value result;
+        result.value = raw;
+        return result;
+    }
+
+    constexpr value_t raw() const {
+        return value;
     }
-    constexpr Value(const Moneybag::coin_number_t num) : 
-        quotient{ num / Moneybag::MOD },
-        rest{ num % Moneybag::MOD } {}
 
     constexpr Value(const Value& num) :
-        quotient{ num.quotient },
-        rest{ num.rest } {}
+        value{ num.value } {}
 
     constexpr Value() :
-        quotient{ 0 },
-        rest{ 0 } {}
+        value{ 0 } {}
 
-    constexpr std::strong_ordering operator<=>(const Value& value) const {
-        if (quotient != value.quotient)
-            return quotient <=> value.quotient;
-        else
-            return rest <=> value.rest;
+    constexpr std::strong_ordering operator<=>(const Value& other) const {
+        return value <=> other.value;
     }
-    
+
     constexpr std::strong_ordering operator<=>(const uint64_t num) const {
-        if (quotient != (num / Moneybag::MOD))
-            return quotient <=> (num / Moneybag::MOD);
-        else
-            return rest <=> (num % Moneybag::MOD);
+        return value <=> value_t(num);
     }
 
     constexpr Value& operator=(const Value& num) {
-        quotient = num.quotient;
-        rest = num.rest;
+        value = num.value;
         return *this;
     }
 
-    constexpr bool operator==(const Value& value) const {
-        return quotient == value.quotient && rest == value.rest;
+    constexpr bool operator==(const Value& other) const {
+        return value == other.value;
     }
 
-    operator std::string() const {
-        if (quotient == 0)
-            return std::to_string(rest);
-        else {
-            std::ostringstream os;
-            os << quotient
-                << std::setfill('0')
-                << std::setw(12)
-                << rest;
-            return std::move(os).str();
+    constexpr Value& operator+=(const Value& other) {
+        value_t result;
+        if (__builtin_add_overflow(value, other.value, &result))
+            throw std::out_of_range("value can not be too large");
+        value = result;
+        return *this;
+    }
+
+    // Zapisuje wartosc dziesietnie do bufora o rozmiarze co najmniej
+    // MAX_DIGITS i zwraca liczbe zapisanych znakow (bez '\0')
+    constexpr std::size_t to_decimal(char* buffer) const noexcept {
+        char digits[MAX_DIGITS];
+        char* const end = digits + MAX_DIGITS;
+        char* pos = end;
+
+        // Bloki po 19 cyfr liczone sa juz na 64 bitach
+        value_t high = value;
+        while (high >= POW19) {
+            pos = write_block(pos, uint64_t(high % POW19));
+            high /= POW19;
         }
+        pos = write_leading(pos, uint64_t(high));
+
+        std::copy(pos, end, buffer);
+        return std::size_t(end - pos);
+    }
+
+    operator std::string() const {
+        char buffer[MAX_DIGITS];
+        return std::string(buffer, to_decimal(buffer));
     }
 private:
-    // Value trzymane jest jako liczba w postaci ilorazu z MOD i reszty z dzielenia z MOD
-    uint64_t quotient;
-    uint64_t rest;
-    static const Moneybag::coin_number_t MOD = 1'000'000'000'000;
-
-    constexpr Value& operator*=(const Moneybag::coin_number_t num) {
-        quotient *= num;
-        rest *= num;
-        quotient += rest / MOD;
-        rest %= MOD;
-        return *this;
+    value_t value;
+
+    static constexpr uint64_t POW19 = 10'000'000'000'000'000'000u;
+
+    static constexpr char DIGIT_PAIRS[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // Zapisuje dokladnie 19 cyfr, uzupelniajac zerami z przodu
+    static constexpr char* write_block(char* pos, uint64_t block) {
+        for (int i = 0; i < 9; ++i) {
+            uint64_t pair = block % 100;
+            block /= 100;
+            *--pos = DIGIT_PAIRS[2 * pair + 1];
+            *--pos = DIGIT_PAIRS[2 * pair];
+        }
+        *--pos = char('0' + block);
+        return pos;
     }
 
-    constexpr Value& operator+=(const Value& value) {
-        quotient += value.quotient;
-        rest += value.rest;
-        quotient += value.rest / MOD;
-        rest %= MOD;
-        return *this;
+    static constexpr char* write_leading(char* pos, uint64_t num) {
+        while (num >= 100) {
+            uint64_t pair = num % 100;
+            num /= 100;
+            *--pos = DIGIT_PAIRS[2 * pair + 1];
+            *--pos = DIGIT_PAIRS[2 * pair];
+        }
+        if (num >= 10) {
+            *--pos = DIGIT_PAIRS[2 * num + 1];
+            *--pos = DIGIT_PAIRS[2 * num];
+        }
+        else
+            *--pos = char('0' + num);
+        return pos;
     }
 };
+
+constexpr std::size_t MONEYBAG_MAX_CHARS = Moneybag::MAX_CHARS;
+
+namespace moneybag_text {
+    inline char* append(char* first, char* last, std::string_view text) {
+        if (first == nullptr || std::size_t(last - first) < text.size())
+            return nullptr;
+        return std::copy(text.begin(), text.end(), first);
+    }
+}
+
+// Zapisuje sakiewke w tej samej postaci co operator<<, bez alokacji.
+// Bufor o rozmiarze Purse::MAX_CHARS zawsze wystarcza.
+template <typename Coins, std::uint64_t... Ratios>
+std::to_chars_result to_chars(char* first, char* last, const Purse<Coins, Ratios...>& purse) {
+    char* pos = moneybag_text::append(first, last, "(");
+    for (std::size_t i = 0; i < Purse<Coins, Ratios...>::COINS && pos != nullptr; ++i) {
+        if (i != 0)
+            pos = moneybag_text::append(pos, last, ", ");
+        if (pos == nullptr)
+            break;
+        std::to_chars_result number = std::to_chars(pos, last, purse.coin_number(i));
+        if (number.ec != std::errc())
+            return { last, std::errc::value_too_large };
+        pos = moneybag_text::append(number.ptr, last, " ");
+        pos = moneybag_text::append(pos, last,
+            purse.coin_number(i) == 1 ? Coins::singular[i] : Coins::plural[i]);
+    }
+    pos = moneybag_text::append(pos, last, ")");
+
+    if (pos == nullptr)
+        return { last, std::errc::value_too_large };
+    return { pos, std::errc() };
+}
+
+inline std::to_chars_result to_chars(char* first, char* last, const Value& value) {
+    char buffer[Value::MAX_DIGITS];
+    std::size_t length = value.to_decimal(buffer);
+    if (std::size_t(last - first) < length)
+        return { last, std::errc::value_too_large };
+    return { std::copy(buffer, buffer + length, first), std::errc() };
+}
+
+// Czyta sakiewke zapisana w postaci kanonicznej, np. "(1 livr, 2 soliduses, 0 deniers)".
+// Forma pojedyncza nazwy jest akceptowana tylko dla liczby 1.
+template <typename Coins, std::uint64_t... Ratios>
+std::from_chars_result from_chars(const char* first, const char* last,
+                                  Purse<Coins, Ratios...>& purse) {
+    const std::from_chars_result invalid{ first, std::errc::invalid_argument };
+    auto skip = [&](const char* pos, std::string_view text) -> const char* {
+        if (pos == nullptr || std::size_t(last - pos) < text.size() ||
+            std::string_view(pos, text.size()) != text)
+            return nullptr;
+        return pos + text.size();
+    };
+
+    std::array<std::uint64_t, Purse<Coins, Ratios...>::COINS> coins;
+    const char* pos = skip(first, "(");
+    for (std::size_t i = 0; i < coins.size(); ++i) {
+        if (i != 0)
+            pos = skip(pos, ", ");
+        if (pos == nullptr)
+            return invalid;
+        std::from_chars_result number = std::from_chars(pos, last, coins[i]);
+        if (number.ec != std::errc())
+            return { first, number.ec };
+        pos = skip(skip(number.ptr, " "),
+            coins[i] == 1 ? Coins::singular[i] : Coins::plural[i]);
+    }
+    pos = skip(pos, ")");
+    if (pos == nullptr)
+        return invalid;
+
+    purse = Purse<Coins, Ratios...>(coins);
+    return { pos, std::errc() };
+}
+
 #endif // MONEYBAG_H
\ No newline at end of file
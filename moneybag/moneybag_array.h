@@ -0,0 +1,222 @@
+#ifndef MONEYBAG_ARRAY_H
+#define MONEYBAG_ARRAY_H
+
+#include "moneybag.h"
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Kolekcja sakiewek w ukladzie struktury tablic: kazdy rodzaj monet ma osobny
+// pas, dzieki czemu petle po elementach nie maja rozgalezien i kompilator moze
+// je zwektoryzowac. Przepelnienia sprawdzane sa zbiorczo dla calej paczki
+// elementow, a dopiero gdy paczka zglosi blad szukany jest konkretny element.
+class MoneybagArray {
+public:
+    using coin_number_t = Moneybag::coin_number_t;
+    using size_type = std::size_t;
+
+    static constexpr size_type BATCH = 256;
+
+    MoneybagArray() = default;
+
+    explicit MoneybagArray(size_type size) :
+        livres(size, 0),
+        soliduses(size, 0),
+        deniers(size, 0) {}
+
+    size_type size() const {
+        return livres.size();
+    }
+
+    bool empty() const {
+        return livres.empty();
+    }
+
+    void reserve(size_type capacity) {
+        livres.reserve(capacity);
+        soliduses.reserve(capacity);
+        deniers.reserve(capacity);
+    }
+
+    void push_back(const Moneybag& m_bag) {
+        livres.push_back(m_bag.livre_number());
+        try {
+            soliduses.push_back(m_bag.solidus_number());
+            try {
+                deniers.push_back(m_bag.denier_number());
+            }
+            catch (...) {
+                soliduses.pop_back();
+                throw;
+            }
+        }
+        catch (...) {
+            livres.pop_back();
+            throw;
+        }
+    }
+
+    Moneybag operator[](size_type i) const {
+        return Moneybag(livres[i], soliduses[i], deniers[i]);
+    }
+
+    void set(size_type i, const Moneybag& m_bag) {
+        livres[i] = m_bag.livre_number();
+        soliduses[i] = m_bag.solidus_number();
+        deniers[i] = m_bag.denier_number();
+    }
+
+    const coin_number_t* livre_data() const {
+        return livres.data();
+    }
+
+    const coin_number_t* solidus_data() const {
+        return soliduses.data();
+    }
+
+    const coin_number_t* denier_data() const {
+        return deniers.data();
+    }
+
+    // Indeks pierwszego elementu, ktory przepelnilby sie przy dodawaniu other.
+    std::optional<size_type> overflow_on_add(const MoneybagArray& other) const {
+        throw_if_size_differs(other);
+        return find_overflow([&](size_type i) {
+            return (livres[i] + other.livres[i] < livres[i]) |
+                (soliduses[i] + other.soliduses[i] < soliduses[i]) |
+                (deniers[i] + other.deniers[i] < deniers[i]);
+        });
+    }
+
+    // Indeks pierwszego elementu, ktory stalby sie ujemny przy odejmowaniu other.
+    std::optional<size_type> overflow_on_subtract(const MoneybagArray& other) const {
+        throw_if_size_differs(other);
+        return find_overflow([&](size_type i) {
+            return (livres[i] < other.livres[i]) |
+                (soliduses[i] < other.soliduses[i]) |
+                (deniers[i] < other.deniers[i]);
+        });
+    }
+
+    // Indeks pierwszego elementu, ktory przepelnilby sie przy mnozeniu przez num.
+    std::optional<size_type> overflow_on_scale(coin_number_t num) const {
+        if (num == 0)
+            return std::nullopt;
+        coin_number_t max_available = coin_number_t(UINT64_MAX) / num;
+        return find_overflow([&](size_type i) {
+            return (livres[i] > max_available) |
+                (soliduses[i] > max_available) |
+                (deniers[i] > max_available);
+        });
+    }
+
+    MoneybagArray& operator+=(const MoneybagArray& other) {
+        if (auto i = overflow_on_add(other))
+            throw std::out_of_range("value can not be too large at index " + std::to_string(*i));
+
+        add_lane(livres, other.livres);
+        add_lane(soliduses, other.soliduses);
+        add_lane(deniers, other.deniers);
+
+        return *this;
+    }
+
+    MoneybagArray& operator-=(const MoneybagArray& other) {
+        if (auto i = overflow_on_subtract(other))
+            throw std::out_of_range("value can not be negative at index " + std::to_string(*i));
+
+        subtract_lane(livres, other.livres);
+        subtract_lane(soliduses, other.soliduses);
+        subtract_lane(deniers, other.deniers);
+
+        return *this;
+    }
+
+    MoneybagArray& operator*=(coin_number_t num) {
+        if (auto i = overflow_on_scale(num))
+            throw std::out_of_range("value can not be too large at index " + std::to_string(*i));
+
+        scale_lane(livres, num);
+        scale_lane(soliduses, num);
+        scale_lane(deniers, num);
+
+        return *this;
+    }
+
+    Moneybag sum() const {
+        return Moneybag(sum_lane(livres), sum_lane(soliduses), sum_lane(deniers));
+    }
+
+private:
+    std::vector<coin_number_t> livres;
+    std::vector<coin_number_t> soliduses;
+    std::vector<coin_number_t> deniers;
+
+    void throw_if_size_differs(const MoneybagArray& other) const {
+        if (size() != other.size())
+            throw std::invalid_argument("arrays must have equal sizes");
+    }
+
+    // Flagi przepelnienia sa sumowane bez rozgalezien w obrebie paczki,
+    // a element winny szukany jest tylko w paczce, ktora zglosila blad.
+    template <typename Check>
+    std::optional<size_type> find_overflow(Check check) const {
+        size_type n = size();
+        for (size_type begin = 0; begin < n; begin += BATCH) {
+            size_type end = std::min(n, begin + BATCH);
+            bool overflow = false;
+            for (size_type i = begin; i < end; ++i)
+                overflow |= check(i);
+            if (!overflow)
+                continue;
+            for (size_type i = begin; i < end; ++i)
+                if (check(i))
+                    return i;
+        }
+        return std::nullopt;
+    }
+
+    static void add_lane(std::vector<coin_number_t>& lane,
+                         const std::vector<coin_number_t>& other) {
+        coin_number_t* __restrict dst = lane.data();
+        const coin_number_t* __restrict src = other.data();
+        for (size_type i = 0, n = lane.size(); i < n; ++i)
+            dst[i] += src[i];
+    }
+
+    static void subtract_lane(std::vector<coin_number_t>& lane,
+                              const std::vector<coin_number_t>& other) {
+        coin_number_t* __restrict dst = lane.data();
+        const coin_number_t* __restrict src = other.data();
+        for (size_type i = 0, n = lane.size(); i < n; ++i)
+            dst[i] -= src[i];
+    }
+
+    static void scale_lane(std::vector<coin_number_t>& lane, coin_number_t num) {
+        for (auto& coins : lane)
+            coins *= num;
+    }
+
+    static coin_number_t sum_lane(const std::vector<coin_number_t>& lane) {
+        coin_number_t total = 0;
+        size_type n = lane.size();
+        for (size_type begin = 0; begin < n; begin += BATCH) {
+            size_type end = std::min(n, begin + BATCH);
+            coin_number_t partial = 0;
+            bool overflow = false;
+            for (size_type i = begin; i < end; ++i) {
+                partial += lane[i];
+                overflow |= partial < lane[i];
+            }
+            if (overflow || total + partial < total)
+                throw std::out_of_range("value can not be too large");
+            total += partial;
+        }
+        return total;
+    }
+};
+
+#endif // MONEYBAG_ARRAY_H
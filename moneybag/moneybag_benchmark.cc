@@ -0,0 +1,333 @@
+// Benchmarki sakiewek. Uruchamiane bez argumentow wykonuja wszystkie
+// pomiary, a z nazwa pomiaru tylko ten jeden. Drugi argument zmienia liczbe
+// sortowanych sakiewek, np. ./a.out sort 100000000 (potrzeba ok. 9 GB).
+//
+// g++ -std=c++20 -O2 -pthread moneybag_benchmark.cc
+
+#include "moneybag.h"
+#include "moneybag_concurrent.h"
+#include "moneybag_reduce.h"
+#include "moneybag_serialize.h"
+#include "moneybag_sort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Skalowanie ConcurrentMoneybagAccumulator z liczba watkow: jedna porcja
+// (wszystkie watki na tych samych licznikach) wobec porcji na watek.
+void benchmark_concurrent() {
+    constexpr size_t ADDS = 1 << 22;
+
+    printf("hardware threads: %u\n", thread::hardware_concurrency());
+    for (size_t threads : { 1, 2, 4, 8, 16 }) {
+        for (size_t shards : { size_t(1), threads }) {
+            ConcurrentMoneybagAccumulator accumulator(shards);
+            size_t const per_thread = ADDS / threads;
+
+            auto const start = chrono::steady_clock::now();
+            vector<thread> workers;
+            for (size_t t = 0; t < threads; ++t)
+                workers.emplace_back([&] {
+                    for (size_t i = 0; i < per_thread; ++i)
+                        accumulator.add(Moneybag(1, i % 20, i % 12));
+                });
+            for (thread& worker : workers)
+                worker.join();
+            double const elapsed = seconds_since(start);
+
+            if (accumulator.snapshot().livre_number() != per_thread * threads) {
+                fprintf(stderr, "concurrent: wrong sum\n");
+                exit(1);
+            }
+            printf("concurrent  %2zu threads %2zu shards  %8.2f Madds/s\n", threads,
+                   shards, ADDS / elapsed / 1e6);
+            if (threads == 1)
+                break;
+        }
+    }
+}
+
+// Sakiewki o typowych, przewaznie malych liczbach monet i czasem bardzo
+// duzych, zeby nie mierzyc tylko jednobajtowych varintow
+vector<Moneybag> random_bags(size_t count) {
+    mt19937_64 random(1);
+    vector<Moneybag> bags;
+    bags.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t const livres = i % 64 == 0 ? random() : random() % 1000;
+        bags.emplace_back(livres, random() % 20, random() % 12);
+    }
+    return bags;
+}
+
+// Predkosc dekodowania MoneybagDecoder w MB/s zakodowanych danych
+void benchmark_serialize() {
+    constexpr size_t BAGS = 1 << 22;
+    constexpr int REPEATS = 5;
+
+    vector<Moneybag> const bags = random_bags(BAGS);
+    vector<uint8_t> buffer;
+    MoneybagEncoder encoder(buffer);
+    for (Moneybag const& bag : bags)
+        encoder.write(bag);
+
+    double best = 1e9;
+    uint64_t checksum = 0;
+    for (int repeat = 0; repeat < REPEATS; ++repeat) {
+        auto const start = chrono::steady_clock::now();
+        MoneybagDecoder decoder(buffer);
+        Moneybag bag(0, 0, 0);
+        while (decoder.read(bag))
+            checksum += bag.livre_number() + bag.solidus_number() + bag.denier_number();
+        best = min(best, seconds_since(start));
+    }
+
+    uint64_t expected = 0;
+    for (Moneybag const& bag : bags)
+        expected += bag.livre_number() + bag.solidus_number() + bag.denier_number();
+    if (checksum != expected * REPEATS) {
+        fprintf(stderr, "serialize: wrong checksum\n");
+        exit(1);
+    }
+    printf("serialize   %.2f bytes/bag  decode %8.2f MB/s  %8.2f Mbags/s\n",
+           double(buffer.size()) / BAGS, buffer.size() / best / 1e6, BAGS / best / 1e6);
+}
+
+// to_chars/from_chars wobec operator<< i odczytu ze strumienia tych samych
+// napisow; liczone sa nanosekundy na sakiewke
+void benchmark_text() {
+    constexpr size_t BAGS = 1 << 20;
+
+    vector<Moneybag> const bags = random_bags(BAGS);
+    uint64_t checksum = 0;
+
+    vector<char> text(BAGS * MONEYBAG_MAX_CHARS);
+    vector<size_t> lengths(BAGS);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < BAGS; ++i) {
+        char* const first = text.data() + i * MONEYBAG_MAX_CHARS;
+        lengths[i] = size_t(to_chars(first, first + MONEYBAG_MAX_CHARS, bags[i]).ptr - first);
+    }
+    double const to_chars_time = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    vector<string> streamed(BAGS);
+    for (size_t i = 0; i < BAGS; ++i) {
+        ostringstream os;
+        os << bags[i];
+        streamed[i] = os.str();
+    }
+    double const ostream_time = seconds_since(start);
+
+    for (size_t i = 0; i < BAGS; ++i)
+        if (streamed[i] != string_view(text.data() + i * MONEYBAG_MAX_CHARS, lengths[i])) {
+            fprintf(stderr, "text: to_chars differs from operator<<\n");
+            exit(1);
+        }
+
+    start = chrono::steady_clock::now();
+    Moneybag bag(0, 0, 0);
+    for (size_t i = 0; i < BAGS; ++i) {
+        char const* const first = text.data() + i * MONEYBAG_MAX_CHARS;
+        from_chars(first, first + lengths[i], bag);
+        checksum += bag.livre_number() + bag.solidus_number() + bag.denier_number();
+    }
+    double const from_chars_time = seconds_since(start);
+
+    // Strumien czyta liczby, a nazwy monet pomija jako slowa
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < BAGS; ++i) {
+        istringstream is(streamed[i]);
+        uint64_t coins[Moneybag::COINS];
+        string name;
+        char separator;
+        is >> separator;
+        for (size_t c = 0; c < Moneybag::COINS; ++c) {
+            is >> coins[c] >> name;
+            checksum -= coins[c];
+        }
+    }
+    double const istream_time = seconds_since(start);
+
+    if (checksum != 0) {
+        fprintf(stderr, "text: from_chars differs from the stream\n");
+        exit(1);
+    }
+    printf("text        to_chars %6.1f ns  operator<< %6.1f ns  "
+           "from_chars %6.1f ns  operator>> %6.1f ns\n",
+           to_chars_time / BAGS * 1e9, ostream_time / BAGS * 1e9,
+           from_chars_time / BAGS * 1e9, istream_time / BAGS * 1e9);
+}
+
+// moneybag_parallel::sum, total_value i max_by_value wobec zwyklych petli,
+// w milisekundach na przebieg po wszystkich sakiewkach
+void benchmark_reduce() {
+    constexpr size_t BAGS = 1 << 23;
+    constexpr int REPEATS = 5;
+
+    vector<Moneybag> bags;
+    {
+        mt19937_64 random(1);
+        bags.reserve(BAGS);
+        for (size_t i = 0; i < BAGS; ++i)
+            bags.emplace_back(random() % 1'000'000, random() % 20, random() % 12);
+    }
+    span<const Moneybag> const all(bags);
+
+    // Najlepszy z kilku przebiegow; wynik laczony jest z sakiewka, zeby
+    // petla nie zostala usunieta
+    Moneybag checksum(0, 0, 0);
+    auto const best_of = [&](auto reduce) {
+        double best = 1e9;
+        for (int repeat = 0; repeat < REPEATS; ++repeat) {
+            auto const start = chrono::steady_clock::now();
+            Moneybag const result = reduce();
+            best = min(best, seconds_since(start));
+            checksum = checksum.checked_add(result).value_or(checksum);
+        }
+        return best * 1e3;
+    };
+
+    double const serial_sum = best_of([&] {
+        Moneybag total(0, 0, 0);
+        for (Moneybag const& bag : bags)
+            total += bag;
+        return total;
+    });
+    double const serial_value = best_of([&] {
+        Value total;
+        for (Moneybag const& bag : bags)
+            total += Value(bag);
+        return Moneybag(uint64_t(total > 0), 0, 0);
+    });
+    double const serial_max = best_of([&] {
+        return *max_element(bags.begin(), bags.end(),
+            [](Moneybag const& a, Moneybag const& b) { return Value(a) < Value(b); });
+    });
+    printf("reduce      serial          sum %8.2f ms  total_value %8.2f ms  "
+           "max_by_value %8.2f ms\n", serial_sum, serial_value, serial_max);
+
+    size_t const hardware_threads = moneybag_parallel::default_threads();
+    for (size_t threads : { size_t(1), size_t(2), hardware_threads }) {
+        double const sum = best_of([&] {
+            return moneybag_parallel::sum(all, threads);
+        });
+        double const value = best_of([&] {
+            return Moneybag(uint64_t(moneybag_parallel::total_value(all, threads) > 0), 0, 0);
+        });
+        double const max = best_of([&] {
+            return *moneybag_parallel::max_by_value(all, threads);
+        });
+        printf("reduce      %2zu threads      sum %8.2f ms  total_value %8.2f ms  "
+               "max_by_value %8.2f ms\n", threads, sum, value, max);
+        if (threads == hardware_threads)
+            break;
+    }
+    if (checksum == Moneybag(0, 0, 0))
+        printf("(%lu)\n", (unsigned long)checksum.livre_number());
+}
+
+size_t sort_size = 10'000'000;
+
+// radix_sort_indices i radix_sort wobec std::stable_sort po Value, dla liczb
+// livrow ponizej miliona (czesc przebiegow jest pomijana) i dla pelnego
+// zakresu 64 bitow (zaden przebieg nie jest pomijany)
+void benchmark_sort() {
+    auto const by_value = [](Moneybag const& a, Moneybag const& b) {
+        return moneybag_sort::value_of(a) < moneybag_sort::value_of(b);
+    };
+
+    for (bool full_range : { false, true }) {
+        vector<Moneybag> bags;
+        {
+            mt19937_64 random(1);
+            bags.reserve(sort_size);
+            for (size_t i = 0; i < sort_size; ++i)
+                bags.emplace_back(full_range ? random() : random() % 1'000'000,
+                                  full_range ? random() : random() % 20,
+                                  full_range ? random() : random() % 12);
+        }
+        char const* const range = full_range ? "full" : "small";
+
+        vector<size_t> radix_order(sort_size), stable_order(sort_size);
+        iota(radix_order.begin(), radix_order.end(), size_t(0));
+        iota(stable_order.begin(), stable_order.end(), size_t(0));
+
+        auto start = chrono::steady_clock::now();
+        moneybag_sort::radix_sort_indices(bags, radix_order);
+        double const radix_indices = seconds_since(start);
+
+        start = chrono::steady_clock::now();
+        stable_sort(stable_order.begin(), stable_order.end(), [&](size_t a, size_t b) {
+            return by_value(bags[a], bags[b]);
+        });
+        double const stable_indices = seconds_since(start);
+
+        if (radix_order != stable_order) {
+            fprintf(stderr, "sort: radix_sort_indices differs from stable_sort\n");
+            exit(1);
+        }
+        radix_order = {};
+        stable_order = {};
+        printf("sort %-5s  %zu bags  indices: radix %8.0f ms  stable_sort %8.0f ms\n",
+               range, sort_size, radix_indices * 1e3, stable_indices * 1e3);
+
+        vector<Moneybag> radix_bags = bags;
+        start = chrono::steady_clock::now();
+        moneybag_sort::radix_sort(radix_bags);
+        double const radix_time = seconds_since(start);
+
+        start = chrono::steady_clock::now();
+        stable_sort(bags.begin(), bags.end(), by_value);
+        double const stable_time = seconds_since(start);
+
+        if (radix_bags != bags) {
+            fprintf(stderr, "sort: radix_sort differs from stable_sort\n");
+            exit(1);
+        }
+        printf("sort %-5s  %zu bags  bags:    radix %8.0f ms  stable_sort %8.0f ms\n",
+               range, sort_size, radix_time * 1e3, stable_time * 1e3);
+    }
+}
+
+struct benchmark_t {
+    char const* name;
+    void (*run)();
+};
+
+constexpr benchmark_t BENCHMARKS[] = {
+    { "concurrent", benchmark_concurrent },
+    { "reduce", benchmark_reduce },
+    { "serialize", benchmark_serialize },
+    { "text", benchmark_text },
+    { "sort", benchmark_sort },
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 2)
+        sort_size = strtoull(argv[2], nullptr, 10);
+    for (benchmark_t const& benchmark : BENCHMARKS)
+        if (argc < 2 || strcmp(argv[1], benchmark.name) == 0)
+            benchmark.run();
+}
@@ -0,0 +1,103 @@
+#ifndef MONEYBAG_CONCURRENT_H
+#define MONEYBAG_CONCURRENT_H
+
+#include "moneybag.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+// Sumator sakiewek dla wielu watkow. Kazdy watek dodaje do wlasnej porcji
+// licznikow (shardu) lezacej w osobnej linii pamieci podrecznej, wiec watki
+// nie rywalizuja o te same dane. snapshot() sumuje wszystkie porcje.
+// Liczba porcji 0 oznacza liczbe watkow sprzetowych.
+class ConcurrentMoneybagAccumulator {
+public:
+    using coin_number_t = Moneybag::coin_number_t;
+
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    explicit ConcurrentMoneybagAccumulator(std::size_t shard_count = 0) :
+        shard_count{ shard_count != 0 ? shard_count
+                                      : std::max(1u, std::thread::hardware_concurrency()) },
+        shards{ std::make_unique<Shard[]>(this->shard_count) } {}
+
+    ConcurrentMoneybagAccumulator(const ConcurrentMoneybagAccumulator&) = delete;
+    ConcurrentMoneybagAccumulator& operator=(const ConcurrentMoneybagAccumulator&) = delete;
+
+    // Rzuca std::out_of_range, gdy porcja watku by sie przepelnila;
+    // wtedy stan sumatora pozostaje bez zmian.
+    void add(const Moneybag& m_bag) {
+        Shard& shard = shards[thread_index() % shard_count];
+
+        if (!add_lane(shard.livre, m_bag.livre_number()))
+            throw std::out_of_range("value can not be too large");
+        if (!add_lane(shard.solidus, m_bag.solidus_number())) {
+            shard.livre.fetch_sub(m_bag.livre_number(), std::memory_order_relaxed);
+            throw std::out_of_range("value can not be too large");
+        }
+        if (!add_lane(shard.denier, m_bag.denier_number())) {
+            shard.livre.fetch_sub(m_bag.livre_number(), std::memory_order_relaxed);
+            shard.solidus.fetch_sub(m_bag.solidus_number(), std::memory_order_relaxed);
+            throw std::out_of_range("value can not be too large");
+        }
+    }
+
+    // Suma wszystkich porcji. Jest dokladna, gdy zadne add() nie trwa
+    // rownolegle; w przeciwnym razie moze zawierac czesc wspolbieznych dodawan.
+    Moneybag snapshot() const {
+        Moneybag total(0, 0, 0);
+        for (std::size_t i = 0; i < shard_count; ++i) {
+            Moneybag part(shards[i].livre.load(std::memory_order_acquire),
+                          shards[i].solidus.load(std::memory_order_acquire),
+                          shards[i].denier.load(std::memory_order_acquire));
+            total += part;
+        }
+        return total;
+    }
+
+    void clear() {
+        for (std::size_t i = 0; i < shard_count; ++i) {
+            shards[i].livre.store(0, std::memory_order_release);
+            shards[i].solidus.store(0, std::memory_order_release);
+            shards[i].denier.store(0, std::memory_order_release);
+        }
+    }
+
+private:
+    struct alignas(CACHE_LINE) Shard {
+        std::atomic<coin_number_t> livre{ 0 };
+        std::atomic<coin_number_t> solidus{ 0 };
+        std::atomic<coin_number_t> denier{ 0 };
+    };
+
+    std::size_t shard_count;
+    std::unique_ptr<Shard[]> shards;
+
+    // Watki dostaja kolejne numery, wiec przy liczbie watkow nie wiekszej
+    // niz liczba porcji kazdy ma porcje na wylacznosc. Licznik jest jeden dla
+    // wszystkich sumatorow i nigdy nie maleje: watki zakonczone nie oddaja
+    // numerow, a watek dostaje ten sam numer w kazdym sumatorze. Przy wielu
+    // krotko zyjacych watkach porcje moga byc wiec dzielone, choc wolnych
+    // porcji jest dosc; wynik jest poprawny, traci tylko szybkosc.
+    static std::size_t thread_index() {
+        static std::atomic<std::size_t> next_index{ 0 };
+        thread_local std::size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    static bool add_lane(std::atomic<coin_number_t>& lane, coin_number_t coins) {
+        coin_number_t current = lane.load(std::memory_order_relaxed);
+        coin_number_t result;
+        do {
+            if (__builtin_add_overflow(current, coins, &result))
+                return false;
+        } while (!lane.compare_exchange_weak(current, result, std::memory_order_release,
+                                             std::memory_order_relaxed));
+        return true;
+    }
+};
+
+#endif // MONEYBAG_CONCURRENT_H
@@ -0,0 +1,133 @@
+#ifndef MONEYBAG_REDUCE_H
+#define MONEYBAG_REDUCE_H
+
+#include "moneybag.h"
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Rownolegle redukcje po ciagach sakiewek. Zakres dzielony jest na spojne
+// fragmenty, a wyniki czesciowe laczone sa w kolejnosci fragmentow, wiec
+// wynik (lacznie z tym, czy nastapilo przepelnienie) jest taki sam jak
+// przy zwyklej petli po operator+=.
+namespace moneybag_parallel {
+    // Ponizej tej liczby elementow na watek nie oplaca sie tworzyc watkow
+    constexpr std::size_t MIN_CHUNK = 1 << 16;
+
+    inline std::size_t default_threads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Wywoluje reduce_chunk(fragment, poczatek_fragmentu) dla kolejnych
+    // fragmentow zakresu i zwraca wyniki w kolejnosci fragmentow.
+    template <typename Result, typename ReduceChunk>
+    std::vector<Result> reduce_chunks(std::span<const Moneybag> bags, std::size_t threads,
+                                      ReduceChunk reduce_chunk) {
+        if (threads == 0)
+            threads = default_threads();
+        std::size_t chunks = std::max<std::size_t>(1,
+            std::min(threads, bags.size() / MIN_CHUNK));
+        std::size_t chunk_size = (bags.size() + chunks - 1) / chunks;
+
+        std::vector<Result> results(chunks);
+        std::vector<std::thread> workers;
+        workers.reserve(chunks - 1);
+        try {
+            for (std::size_t i = 1; i < chunks; ++i) {
+                std::size_t begin = std::min(bags.size(), i * chunk_size);
+                std::size_t end = std::min(bags.size(), begin + chunk_size);
+                workers.emplace_back([&, i, begin, end] {
+                    results[i] = reduce_chunk(bags.subspan(begin, end - begin), begin);
+                });
+            }
+        }
+        catch (...) {
+            for (auto& worker : workers)
+                worker.join();
+            throw;
+        }
+        results[0] = reduce_chunk(bags.first(std::min(bags.size(), chunk_size)), 0);
+        for (auto& worker : workers)
+            worker.join();
+
+        return results;
+    }
+
+    // Suma sakiewek; rzuca std::out_of_range dokladnie wtedy, gdy zrobilaby to
+    // petla szeregowa, bo sumy czesciowe monet tylko rosna.
+    inline Moneybag sum(std::span<const Moneybag> bags, std::size_t threads = 0) {
+        auto partial = reduce_chunks<std::optional<Moneybag>>(bags, threads,
+            [](std::span<const Moneybag> chunk, std::size_t) -> std::optional<Moneybag> {
+                // Przepelnienie sprawdzane jest raz na fragment, a nie po
+                // kazdej sakiewce; po przepelnieniu suma juz sie nie liczy
+                std::array<Moneybag::coin_number_t, Moneybag::COINS> total{};
+                bool overflow = false;
+                for (const Moneybag& m_bag : chunk)
+                    for (std::size_t i = 0; i < Moneybag::COINS; ++i)
+                        overflow |= __builtin_add_overflow(total[i], m_bag.coin_number(i),
+                                                           &total[i]);
+                if (overflow)
+                    return std::nullopt;
+                return Moneybag(total);
+            });
+
+        Moneybag total(0, 0, 0);
+        for (const auto& part : partial) {
+            if (!part)
+                throw std::out_of_range("value can not be too large");
+            total += *part;
+        }
+        return total;
+    }
+
+    inline Value total_value(std::span<const Moneybag> bags, std::size_t threads = 0) {
+        auto partial = reduce_chunks<Value>(bags, threads,
+            [](std::span<const Moneybag> chunk, std::size_t) {
+                Value total;
+                for (const Moneybag& m_bag : chunk)
+                    total += Value(m_bag);
+                return total;
+            });
+
+        Value total;
+        for (const auto& part : partial)
+            total += part;
+        return total;
+    }
+
+    // Pierwsza sakiewka o najwiekszej wartosci, jak std::max_element;
+    // dla pustego zakresu zwraca bags.end().
+    inline std::span<const Moneybag>::iterator max_by_value(std::span<const Moneybag> bags,
+                                                             std::size_t threads = 0) {
+        if (bags.empty())
+            return bags.end();
+
+        struct Best {
+            std::size_t index = 0;
+            Value value;
+        };
+        auto partial = reduce_chunks<Best>(bags, threads,
+            [](std::span<const Moneybag> chunk, std::size_t offset) {
+                Best best{ offset, Value(chunk.front()) };
+                for (std::size_t i = 1; i < chunk.size(); ++i) {
+                    Value value(chunk[i]);
+                    if (value > best.value)
+                        best = { offset + i, value };
+                }
+                return best;
+            });
+
+        Best best = partial.front();
+        for (const auto& part : partial)
+            if (part.value > best.value)
+                best = part;
+        return bags.begin() + best.index;
+    }
+}
+
+#endif // MONEYBAG_REDUCE_H
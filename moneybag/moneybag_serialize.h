@@ -0,0 +1,240 @@
+#ifndef MONEYBAG_SERIALIZE_H
+#define MONEYBAG_SERIALIZE_H
+
+#include "moneybag.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Zwarty zapis binarny sakiewek i wartosci. Kazda liczba zapisywana jest jako
+// varint (LEB128): po 7 bitow na bajt, najstarszy bit oznacza kontynuacje.
+// Male liczby monet zajmuja wiec 1 bajt zamiast 8.
+namespace moneybag_binary {
+    // Najdluzszy varint liczby 64-bitowej i 128-bitowej
+    constexpr std::size_t MAX_VARINT64 = 10;
+    constexpr std::size_t MAX_VARINT128 = 19;
+
+    // Najdluzszy zapis rekordu danego typu
+    template <typename Record>
+    constexpr std::size_t MAX_BYTES = MAX_VARINT128;
+
+    template <typename Coins, std::uint64_t... Ratios>
+    constexpr std::size_t MAX_BYTES<Purse<Coins, Ratios...>> =
+        Purse<Coins, Ratios...>::COINS * MAX_VARINT64;
+
+    template <typename Unsigned>
+    std::uint8_t* encode_varint(Unsigned value, std::uint8_t* out) {
+        while (value >= 0x80) {
+            *out++ = std::uint8_t(value) | 0x80;
+            value >>= 7;
+        }
+        *out++ = std::uint8_t(value);
+        return out;
+    }
+
+    // Zwraca wskaznik za odczytana liczba albo nullptr, gdy dane sa ucinane,
+    // liczba nie miesci sie w typie Unsigned lub zapis nie jest najkrotszy
+    // (ostatni bajt wielobajtowego zapisu jest zerem, np. 0x80 0x00).
+    template <typename Unsigned>
+    const std::uint8_t* decode_varint(const std::uint8_t* pos, const std::uint8_t* last,
+                                      Unsigned& value) {
+        // Najczestszy przypadek: liczba mniejsza od 128 zajmuje jeden bajt
+        if (pos != last && *pos < 0x80) {
+            value = *pos;
+            return pos + 1;
+        }
+        // Drugi co do czestosci: dwa bajty, czyli liczba ponizej 2^14
+        if (last - pos >= 2 && pos[1] < 0x80 && pos[1] != 0) {
+            value = Unsigned(pos[0] & 0x7f) | Unsigned(pos[1]) << 7;
+            return pos + 2;
+        }
+
+        constexpr unsigned BITS = sizeof(Unsigned) * 8;
+        Unsigned result = 0;
+        for (unsigned shift = 0; pos != last && shift < BITS; shift += 7) {
+            std::uint8_t byte = *pos++;
+            Unsigned chunk = Unsigned(byte & 0x7f);
+            if (shift + 7 > BITS && (chunk >> (BITS - shift)) != 0)
+                return nullptr;
+            result |= chunk << shift;
+            if (!(byte & 0x80)) {
+                if (byte == 0)
+                    return nullptr;
+                value = result;
+                return pos;
+            }
+        }
+        return nullptr;
+    }
+
+    template <typename Coins, std::uint64_t... Ratios>
+    std::uint8_t* encode(const Purse<Coins, Ratios...>& purse, std::uint8_t* out) {
+        for (std::size_t i = 0; i < Purse<Coins, Ratios...>::COINS; ++i)
+            out = encode_varint(purse.coin_number(i), out);
+        return out;
+    }
+
+    template <typename Coins, std::uint64_t... Ratios>
+    const std::uint8_t* decode(const std::uint8_t* pos, const std::uint8_t* last,
+                               Purse<Coins, Ratios...>& purse) {
+        std::array<std::uint64_t, Purse<Coins, Ratios...>::COINS> coins;
+        for (std::size_t i = 0; i < coins.size() && pos != nullptr; ++i)
+            pos = decode_varint(pos, last, coins[i]);
+        if (pos != nullptr)
+            purse = Purse<Coins, Ratios...>(coins);
+        return pos;
+    }
+
+    inline std::uint8_t* encode(const Value& value, std::uint8_t* out) {
+        return encode_varint(value.raw(), out);
+    }
+
+    inline const std::uint8_t* decode(const std::uint8_t* pos, const std::uint8_t* last,
+                                      Value& value) {
+        Value::value_t raw;
+        pos = decode_varint(pos, last, raw);
+        if (pos != nullptr)
+            value = Value::from_raw(raw);
+        return pos;
+    }
+}
+
+// Dopisuje zakodowane sakiewki i wartosci na koniec bufora.
+class MoneybagEncoder {
+public:
+    explicit MoneybagEncoder(std::vector<std::uint8_t>& buffer) :
+        buffer{ buffer } {}
+
+    template <typename Record>
+    void write(const Record& record) {
+        std::uint8_t encoded[moneybag_binary::MAX_BYTES<Record>];
+        append(encoded, moneybag_binary::encode(record, encoded));
+    }
+
+private:
+    std::vector<std::uint8_t>& buffer;
+
+    void append(const std::uint8_t* first, const std::uint8_t* last) {
+        buffer.insert(buffer.end(), first, last);
+    }
+};
+
+// Odczytuje kolejne rekordy z bufora. read() zwraca false na koncu danych
+// i rzuca std::invalid_argument, gdy rekord jest uszkodzony lub uciety.
+class MoneybagDecoder {
+public:
+    explicit MoneybagDecoder(std::span<const std::uint8_t> data) :
+        pos{ data.data() },
+        last{ data.data() + data.size() } {}
+
+    template <typename Record>
+    bool read(Record& record) {
+        if (pos == last)
+            return false;
+        const std::uint8_t* next = moneybag_binary::decode(pos, last, record);
+        if (next == nullptr)
+            throw std::invalid_argument("malformed moneybag record");
+        pos = next;
+        return true;
+    }
+
+    std::size_t remaining() const {
+        return std::size_t(last - pos);
+    }
+
+private:
+    const std::uint8_t* pos;
+    const std::uint8_t* last;
+};
+
+// Zapis rekordow do strumienia (np. pliku) paczkami po CHUNK bajtow.
+class MoneybagStreamWriter {
+public:
+    static constexpr std::size_t CHUNK = 1 << 16;
+
+    explicit MoneybagStreamWriter(std::ostream& os) :
+        os{ os },
+        encoder{ buffer } {
+        buffer.reserve(CHUNK + moneybag_binary::MAX_VARINT128);
+    }
+
+    MoneybagStreamWriter(const MoneybagStreamWriter&) = delete;
+    MoneybagStreamWriter& operator=(const MoneybagStreamWriter&) = delete;
+
+    ~MoneybagStreamWriter() {
+        try {
+            flush();
+        }
+        catch (...) {}
+    }
+
+    template <typename Record>
+    void write(const Record& record) {
+        encoder.write(record);
+        if (buffer.size() >= CHUNK)
+            flush();
+    }
+
+    void flush() {
+        os.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+        buffer.clear();
+        if (!os)
+            throw std::ios_base::failure("can not write moneybag records");
+    }
+
+private:
+    std::ostream& os;
+    std::vector<std::uint8_t> buffer;
+    MoneybagEncoder encoder;
+};
+
+// Odczyt rekordow ze strumienia paczkami po CHUNK bajtow. Rekord przeciety
+// granica paczki jest przenoszony na poczatek bufora przed doczytaniem.
+class MoneybagStreamReader {
+public:
+    static constexpr std::size_t CHUNK = 1 << 16;
+
+    explicit MoneybagStreamReader(std::istream& is) :
+        is{ is },
+        buffer(CHUNK) {}
+
+    template <typename Record>
+    bool read(Record& record) {
+        if (std::size_t(last - pos) < moneybag_binary::MAX_BYTES<Record> &&
+            !refill() && pos == last)
+            return false;
+
+        const std::uint8_t* next = moneybag_binary::decode(pos, last, record);
+        if (next == nullptr)
+            throw std::invalid_argument("malformed moneybag record");
+        pos = next;
+        return true;
+    }
+
+private:
+    std::istream& is;
+    std::vector<std::uint8_t> buffer;
+    const std::uint8_t* pos = nullptr;
+    const std::uint8_t* last = nullptr;
+
+    // Zwraca false, gdy strumien sie skonczyl
+    bool refill() {
+        std::size_t kept = std::size_t(last - pos);
+        if (kept != 0)
+            std::memmove(buffer.data(), pos, kept);
+        is.read(reinterpret_cast<char*>(buffer.data() + kept),
+                std::streamsize(buffer.size() - kept));
+        std::size_t got = std::size_t(is.gcount());
+        pos = buffer.data();
+        last = buffer.data() + kept + got;
+        return got != 0;
+    }
+};
+
+#endif // MONEYBAG_SERIALIZE_H
@@ -0,0 +1,129 @@
+#ifndef MONEYBAG_SORT_H
+#define MONEYBAG_SORT_H
+
+#include "moneybag.h"
+
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Sortowanie sakiewek wedlug wartosci (Value) sortowaniem pozycyjnym LSD.
+// Wartosc sakiewki miesci sie w 73 bitach, wiec kluczem sa po prostu starsze
+// bity 128-bitowego rekordu.
+namespace moneybag_sort {
+    constexpr Value::value_t value_of(const Moneybag& m_bag) {
+        return Value::value_t(m_bag.livre_number()) * Moneybag::FACTORS[0] +
+            Value::value_t(m_bag.solidus_number()) * Moneybag::FACTORS[1] +
+            m_bag.denier_number();
+    }
+
+    // Sortowane sa 128-bitowe rekordy: wartosc w starszych 73 bitach i pozycja
+    // elementu w mlodszych 55 bitach, wiec kazdy przebieg przenosi jedna tablice.
+    // Cyfra ma 11 bitow (2048 kubelkow miesci sie w pamieci podrecznej),
+    // a histogramy wszystkich cyfr liczone sa w jednym przejsciu po danych.
+    constexpr std::size_t INDEX_BITS = 55;
+    constexpr std::size_t DIGIT_BITS = 11;
+    constexpr std::size_t DIGITS = (128 - INDEX_BITS + DIGIT_BITS - 1) / DIGIT_BITS;
+    constexpr std::size_t BUCKETS = std::size_t(1) << DIGIT_BITS;
+
+    constexpr std::size_t digit(Value::value_t record, std::size_t pass) {
+        return std::size_t(record >> (INDEX_BITS + pass * DIGIT_BITS)) & (BUCKETS - 1);
+    }
+
+    constexpr Value::value_t INDEX_MASK = (Value::value_t(1) << INDEX_BITS) - 1;
+
+    // Sortuje rekordy, ktorych histogramy cyfr sa juz w count; wynik trafia
+    // do records albo do buffer, a zwracany jest wskaznik na niego.
+    inline const Value::value_t* sort_records(std::vector<Value::value_t>& records,
+                                              std::vector<Value::value_t>& buffer,
+                                              std::vector<std::size_t>& count) {
+        std::size_t n = records.size();
+        Value::value_t* from = records.data();
+        Value::value_t* to = buffer.data();
+
+        for (std::size_t pass = 0; pass < DIGITS; ++pass) {
+            std::size_t* pass_count = count.data() + pass * BUCKETS;
+
+            // Przebieg, w ktorym wszystkie rekordy maja te sama cyfre, nic nie zmienia
+            if (pass_count[digit(from[0], pass)] == n)
+                continue;
+
+            std::size_t offset = 0;
+            for (std::size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+                std::size_t bucket_size = pass_count[bucket];
+                pass_count[bucket] = offset;
+                offset += bucket_size;
+            }
+
+            for (std::size_t i = 0; i < n; ++i)
+                to[pass_count[digit(from[i], pass)]++] = from[i];
+            std::swap(from, to);
+        }
+        return from;
+    }
+
+    // Rekordy dla kolejnych elementow bags[index(i)] wraz z histogramami cyfr
+    template <typename Index>
+    std::vector<Value::value_t> make_records(std::span<const Moneybag> bags, std::size_t n,
+                                             Index index, std::vector<std::size_t>& count) {
+        if (n >> INDEX_BITS)
+            throw std::length_error("too many elements to sort");
+
+        std::vector<Value::value_t> records(n);
+        count.assign(DIGITS * BUCKETS, 0);
+        for (std::size_t i = 0; i < n; ++i) {
+            records[i] = value_of(bags[index(i)]) << INDEX_BITS | i;
+            for (std::size_t pass = 0; pass < DIGITS; ++pass)
+                ++count[pass * BUCKETS + digit(records[i], pass)];
+        }
+        return records;
+    }
+
+    // Stabilnie sortuje indeksy elementow bags rosnaco wedlug wartosci.
+    inline void radix_sort_indices(std::span<const Moneybag> bags,
+                                   std::span<std::size_t> indices) {
+        std::size_t n = indices.size();
+        if (n < 2)
+            return;
+
+        std::vector<std::size_t> count;
+        std::vector<Value::value_t> records = make_records(bags, n,
+            [&](std::size_t i) { return indices[i]; }, count);
+        std::vector<Value::value_t> buffer(n);
+        const Value::value_t* sorted = sort_records(records, buffer, count);
+
+        std::vector<std::size_t> original(indices.begin(), indices.end());
+        for (std::size_t i = 0; i < n; ++i)
+            indices[i] = original[std::size_t(sorted[i] & INDEX_MASK)];
+    }
+
+    // Stabilnie sortuje sakiewki rosnaco wedlug wartosci. Sortowane sa same
+    // rekordy, a sakiewki przenoszone sa raz, na koncu. Zysk wobec
+    // std::stable_sort jest mniejszy niz dla radix_sort_indices, bo
+    // stable_sort przenosi sakiewki bez posrednich indeksow.
+    inline void radix_sort(std::span<Moneybag> bags) {
+        std::size_t n = bags.size();
+        if (n < 2)
+            return;
+
+        std::vector<std::size_t> count;
+        std::vector<Value::value_t> records = make_records(bags, n,
+            [](std::size_t i) { return i; }, count);
+        std::vector<Value::value_t> buffer(n);
+        const Value::value_t* sorted_records = sort_records(records, buffer, count);
+        if (sorted_records == records.data())
+            buffer = {};
+        else
+            records = {};
+
+        std::vector<Moneybag> sorted;
+        sorted.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+            sorted.push_back(bags[std::size_t(sorted_records[i] & INDEX_MASK)]);
+        std::copy(sorted.begin(), sorted.end(), bags.begin());
+    }
+}
+
+#endif // MONEYBAG_SORT_H
@@ -0,0 +1,465 @@
+// Testy sakiewek. Sprawdzenia nie zaleza od NDEBUG.
+//
+// g++ -std=c++20 -O2 -pthread moneybag_test.cc
+
+#include "moneybag.h"
+#include "moneybag_array.h"
+#include "moneybag_reduce.h"
+#include "moneybag_serialize.h"
+#include "moneybag_sort.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void check(bool condition, char const* what, int line) {
+    if (!condition) {
+        fprintf(stderr, "line %d: %s\n", line, what);
+        exit(1);
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+// Sakiewke mozna zapisac jako liste liczb monet, ale pojedyncza liczba nie
+// zamienia sie niejawnie w sakiewke jednej monety
+template <typename Bag>
+concept from_braced_numbers = requires(void (*take)(Bag)) { take({ 1, 2, 3 }); };
+
+struct PennyCoins {
+    static constexpr string_view singular[] = { "penny" };
+    static constexpr string_view plural[] = { "pennies" };
+};
+
+static_assert(from_braced_numbers<Moneybag>);
+static_assert([] {
+    Moneybag bag = { 1, 2, 3 };
+    return bag == Moneybag(1, 2, 3);
+}());
+static_assert(!is_convertible_v<int, Purse<PennyCoins>>);
+static_assert(is_constructible_v<Purse<PennyCoins>, int>);
+
+// Operacje bez wyjatkow: przepelnienie kazdej monety osobno i wyniki
+// dokladnie na granicach
+constexpr uint64_t MAX_COINS = numeric_limits<uint64_t>::max();
+
+static_assert(!Moneybag(MAX_COINS, 0, 0).checked_add(Livre));
+static_assert(!Moneybag(0, MAX_COINS, 0).checked_add(Solidus));
+static_assert(!Moneybag(0, 0, MAX_COINS).checked_add(Denier));
+static_assert(!Moneybag(1, 1, MAX_COINS).checked_add(Moneybag(MAX_COINS - 1, 0, 1)));
+static_assert(Moneybag(MAX_COINS - 1, 0, 0).checked_add(Livre) ==
+              Moneybag(MAX_COINS, 0, 0));
+static_assert(Moneybag(1, 2, 3).checked_add(Moneybag(MAX_COINS - 1, MAX_COINS - 2,
+                                                     MAX_COINS - 3)) ==
+              Moneybag(MAX_COINS, MAX_COINS, MAX_COINS));
+
+static_assert(!Moneybag(0, 5, 5).checked_sub(Livre));
+static_assert(!Moneybag(5, 0, 5).checked_sub(Solidus));
+static_assert(!Moneybag(5, 5, 0).checked_sub(Denier));
+// Wartosc sakiewki wystarczylaby, ale monety odejmowane sa osobno
+static_assert(!Livre.checked_sub(Solidus));
+static_assert(Moneybag(1, 2, 3).checked_sub(Moneybag(1, 2, 3)) == Moneybag(0, 0, 0));
+static_assert(Moneybag(MAX_COINS, MAX_COINS, MAX_COINS).checked_sub(
+                  Moneybag(MAX_COINS, 0, 1)) == Moneybag(0, MAX_COINS, MAX_COINS - 1));
+
+static_assert(!Moneybag(MAX_COINS / 2 + 1, 0, 0).checked_mul(2));
+static_assert(!Moneybag(0, 0, MAX_COINS).checked_mul(2));
+static_assert(!Moneybag(1, 1, 1ull << 32).checked_mul(1ull << 32));
+static_assert(Moneybag(MAX_COINS / 2, 0, 0).checked_mul(2) ==
+              Moneybag(MAX_COINS - 1, 0, 0));
+// 2^64 - 1 dzieli sie przez 3 i przez 5
+static_assert(Moneybag(MAX_COINS / 3, MAX_COINS / 3, 1).checked_mul(3) ==
+              Moneybag(MAX_COINS, MAX_COINS, 3));
+static_assert(Moneybag(0, MAX_COINS / 5, 7).checked_mul(5) ==
+              Moneybag(0, MAX_COINS, 35));
+static_assert(!Moneybag(0, MAX_COINS / 5 + 1, 7).checked_mul(5));
+static_assert(Moneybag(MAX_COINS, MAX_COINS, MAX_COINS).checked_mul(1) ==
+              Moneybag(MAX_COINS, MAX_COINS, MAX_COINS));
+static_assert(Moneybag(MAX_COINS, MAX_COINS, MAX_COINS).checked_mul(0) ==
+              Moneybag(0, 0, 0));
+
+// Porownanie z uint64_t nie obcina wartosci powyzej 2^64
+constexpr Value::value_t TWO_TO_64 = Value::value_t(1) << 64;
+
+static_assert(Value::from_raw(TWO_TO_64) > MAX_COINS);
+static_assert(Value::from_raw(TWO_TO_64 + 5) > uint64_t(5));
+static_assert(Value::from_raw(TWO_TO_64 + 5) != uint64_t(5));
+static_assert(Value::from_raw(TWO_TO_64 - 1) == MAX_COINS);
+static_assert(Value(Moneybag(MAX_COINS, 0, 0)) > MAX_COINS);
+static_assert(Value(Moneybag(0, 0, MAX_COINS)) == MAX_COINS);
+static_assert(Value(Moneybag(0, 0, MAX_COINS)) < Value(Moneybag(0, 1, MAX_COINS)));
+
+template <typename Record>
+bool decodes(vector<uint8_t> const& bytes, Record& record) {
+    return moneybag_binary::decode(bytes.data(), bytes.data() + bytes.size(), record) ==
+        bytes.data() + bytes.size();
+}
+
+template <typename Record>
+bool rejects(vector<uint8_t> const& bytes, Record record) {
+    return moneybag_binary::decode(bytes.data(), bytes.data() + bytes.size(), record) ==
+        nullptr;
+}
+
+vector<Moneybag> sample_bags() {
+    constexpr uint64_t MAX = numeric_limits<uint64_t>::max();
+    vector<Moneybag> bags = {
+        Moneybag(0, 0, 0), Moneybag(1, 2, 3), Moneybag(127, 128, 16383),
+        Moneybag(16384, MAX, 0), Moneybag(MAX, MAX, MAX),
+    };
+    mt19937_64 random(1);
+    for (int i = 0; i < 100'000; ++i)
+        bags.emplace_back(random() >> (random() % 64), random() % 20, random() % 12);
+    return bags;
+}
+
+void test_varint() {
+    Moneybag bag(0, 0, 0);
+    CHECK(decodes<Moneybag>({ 0x00, 0x01, 0x7f }, bag));
+    CHECK(bag == Moneybag(0, 1, 127));
+    CHECK(decodes<Moneybag>({ 0x80, 0x01, 0xff, 0x7f, 0x05 }, bag));
+    CHECK(bag == Moneybag(128, 16383, 5));
+
+    // Zapisy dluzsze niz trzeba
+    CHECK(rejects({ 0x80, 0x00, 0x00, 0x00 }, bag));
+    CHECK(rejects({ 0x00, 0x81, 0x80, 0x00, 0x00 }, bag));
+    CHECK(rejects({ 0xff, 0x80, 0x00 }, Value()));
+    // Ucinane dane
+    CHECK(rejects({ 0x01, 0x02 }, bag));
+    CHECK(rejects({ 0x01, 0x02, 0x80 }, bag));
+    // Liczba nie miesci sie w 64 bitach
+    CHECK(rejects({ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02,
+                    0x00, 0x00 }, bag));
+    CHECK(decodes<Moneybag>({ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01,
+                              0x00, 0x00 }, bag));
+    CHECK(bag == Moneybag(numeric_limits<uint64_t>::max(), 0, 0));
+}
+
+string decimal(Value const& value) {
+    return string(value);
+}
+
+// Zapis dziesietny przy granicach blokow 19 cyfr i przy MAX_DIGITS
+void test_value_decimal() {
+    CHECK(decimal(Value()) == "0");
+    CHECK(decimal(Value(Moneybag(MAX_COINS, MAX_COINS, MAX_COINS))) ==
+          "4667026250648516558595");
+    CHECK(decimal(Value(MAX_COINS)) == "18446744073709551615");
+    CHECK(decimal(Value::from_raw(TWO_TO_64)) == "18446744073709551616");
+    CHECK(decimal(Value::from_raw(~Value::value_t(0))) ==
+          "340282366920938463463374607431768211455");
+    CHECK(decimal(Value::from_raw(~Value::value_t(0))).size() == Value::MAX_DIGITS);
+
+    Value::value_t power = 1;
+    for (size_t digits = 1; digits <= Value::MAX_DIGITS; ++digits) {
+        // power == 10^(digits - 1)
+        string expected(digits, '0');
+        expected.front() = '1';
+        CHECK(decimal(Value::from_raw(power)) == expected);
+        expected.back() = char(expected.back() + 1);
+        CHECK(decimal(Value::from_raw(power + 1)) == expected);
+        if (digits > 1)
+            CHECK(decimal(Value::from_raw(power - 1)) == string(digits - 1, '9'));
+        if (digits < Value::MAX_DIGITS)
+            power *= 10;
+    }
+}
+
+void test_buffer_round_trip() {
+    vector<Moneybag> const bags = sample_bags();
+    vector<uint8_t> buffer;
+    MoneybagEncoder encoder(buffer);
+    for (Moneybag const& bag : bags) {
+        encoder.write(bag);
+        encoder.write(Value(bag));
+    }
+
+    MoneybagDecoder decoder(buffer);
+    Moneybag bag(0, 0, 0);
+    Value value;
+    for (Moneybag const& expected : bags) {
+        CHECK(decoder.read(bag) && bag == expected);
+        CHECK(decoder.read(value) && value == Value(expected));
+    }
+    CHECK(!decoder.read(bag));
+    CHECK(decoder.remaining() == 0);
+
+    buffer.pop_back();
+    MoneybagDecoder truncated(buffer);
+    bool thrown = false;
+    try {
+        while (truncated.read(bag) && truncated.read(value)) {}
+    }
+    catch (invalid_argument const&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+// Rekordy przecinaja granice paczek MoneybagStreamReader
+void test_stream_round_trip() {
+    vector<Moneybag> const bags = sample_bags();
+    stringstream stream;
+    {
+        MoneybagStreamWriter writer(stream);
+        for (Moneybag const& bag : bags)
+            writer.write(bag);
+    }
+
+    MoneybagStreamReader reader(stream);
+    Moneybag bag(0, 0, 0);
+    for (Moneybag const& expected : bags)
+        CHECK(reader.read(bag) && bag == expected);
+    CHECK(!reader.read(bag));
+}
+
+bool throws_out_of_range(function<void()> const& f) {
+    try {
+        f();
+    }
+    catch (out_of_range const&) {
+        return true;
+    }
+    return false;
+}
+
+// Wyniki rownoleglych redukcji porownywane sa ze zwykla petla
+void check_reduce(vector<Moneybag> const& bags) {
+    bool serial_overflow = false;
+    Moneybag serial_sum(0, 0, 0);
+    try {
+        for (Moneybag const& bag : bags)
+            serial_sum += bag;
+    }
+    catch (out_of_range const&) {
+        serial_overflow = true;
+    }
+    Value serial_value;
+    for (Moneybag const& bag : bags)
+        serial_value += Value(bag);
+    auto const serial_max = max_element(bags.begin(), bags.end(),
+        [](Moneybag const& a, Moneybag const& b) { return Value(a) < Value(b); });
+
+    span<const Moneybag> const all(bags);
+    for (size_t threads : { 0, 1, 2, 3, 8 }) {
+        if (serial_overflow)
+            CHECK(throws_out_of_range([&] { moneybag_parallel::sum(all, threads); }));
+        else
+            CHECK(moneybag_parallel::sum(all, threads) == serial_sum);
+        CHECK(moneybag_parallel::total_value(all, threads) == serial_value);
+        CHECK(moneybag_parallel::max_by_value(all, threads) - all.begin() ==
+              serial_max - bags.begin());
+    }
+}
+
+void test_reduce() {
+    constexpr uint64_t MAX = numeric_limits<uint64_t>::max();
+    // Kilka fragmentow dla wiekszej liczby watkow, ostatni niepelny
+    size_t const size = 4 * moneybag_parallel::MIN_CHUNK + 17;
+
+    check_reduce({});
+    check_reduce({ Moneybag(1, 2, 3) });
+    check_reduce({ Moneybag(MAX, 0, 0) });
+
+    mt19937_64 random(1);
+    vector<Moneybag> bags;
+    for (size_t i = 0; i < size; ++i)
+        bags.emplace_back(random() % 1000, random() % 20, random() % 12);
+    check_reduce(bags);
+
+    // Przepelnienie wewnatrz jednego fragmentu, wewnatrz ostatniego i
+    // dopiero przy laczeniu fragmentow
+    for (auto [first, second] : { pair<size_t, size_t>(size / 2, size / 2 + 5),
+                                  pair<size_t, size_t>(size - 2, size - 1),
+                                  pair<size_t, size_t>(3, size - 3) }) {
+        vector<Moneybag> overflowing = bags;
+        overflowing[first] = Moneybag(0, MAX - 5, 0);
+        overflowing[second] = Moneybag(0, MAX - 5, 0);
+        check_reduce(overflowing);
+    }
+    // Deniery przepelniaja sie dopiero po dodaniu wszystkich fragmentow
+    vector<Moneybag> spread(size, Moneybag(0, 0, MAX / size + 1));
+    check_reduce(spread);
+
+    // Rowne najwieksze wartosci w kilku fragmentach, takze zapisane innymi
+    // monetami: wygrywa pierwsza
+    for (size_t first : { size_t(0), size / 3, size - 1 }) {
+        vector<Moneybag> ties = bags;
+        ties[first] = Moneybag(5000, 0, 0);
+        for (size_t i = first + 1; i < size; i += size / 5)
+            ties[i] = Moneybag(4999, 19, 12);
+        ties[size - 1] = Moneybag(4999, 20, 0);
+        check_reduce(ties);
+    }
+}
+
+vector<Moneybag> elements(MoneybagArray const& array) {
+    vector<Moneybag> result;
+    for (size_t i = 0; i < array.size(); ++i)
+        result.push_back(array[i]);
+    return result;
+}
+
+MoneybagArray array_of(vector<Moneybag> const& bags) {
+    MoneybagArray array;
+    for (Moneybag const& bag : bags)
+        array.push_back(bag);
+    return array;
+}
+
+// Pierwszy element, dla ktorego operation zwraca nullopt, wyznaczony petla po
+// pojedynczych sakiewkach
+template <typename Operation>
+optional<size_t> first_failing(vector<Moneybag> const& bags, Operation operation) {
+    for (size_t i = 0; i < bags.size(); ++i)
+        if (!operation(i))
+            return i;
+    return nullopt;
+}
+
+// Operacja na calej tablicy zglasza ten sam indeks co petla po elementach
+// (ktora musi wskazac first, a bags.size(), gdy zaden element sie nie
+// przepelnia), a gdy rzuca wyjatek, nie zmienia tablicy
+template <typename Operation, typename Checked, typename Overflow>
+void check_array_operation(vector<Moneybag> const& bags, size_t first,
+                           Operation apply, Checked checked, Overflow overflow) {
+    MoneybagArray array = array_of(bags);
+    size_t const expected = first_failing(bags, checked).value_or(bags.size());
+    CHECK(expected == first);
+    CHECK(overflow(array).value_or(bags.size()) == expected);
+    if (expected < bags.size()) {
+        CHECK(throws_out_of_range([&] { apply(array); }));
+        CHECK(elements(array) == bags);
+    }
+    else {
+        apply(array);
+        for (size_t i = 0; i < bags.size(); ++i)
+            CHECK(optional<Moneybag>(array[i]) == checked(i));
+    }
+}
+
+void test_array() {
+    constexpr uint64_t MAX = numeric_limits<uint64_t>::max();
+    // Trzy pelne paczki i niepelna ostatnia
+    size_t const size = 3 * MoneybagArray::BATCH + 5;
+
+    mt19937_64 random(1);
+    vector<Moneybag> bags, others;
+    for (size_t i = 0; i < size; ++i) {
+        bags.emplace_back(2000 + random() % 1000, 40 + random() % 20, 24 + random() % 12);
+        others.emplace_back(3 + random() % 1000, 3 + random() % 20, 3 + random() % 12);
+    }
+
+    // Przepelnienie w pierwszym, srodkowym i ostatnim elemencie, na roznych
+    // monetach, oraz w dwoch elementach jednej paczki naraz
+    for (vector<size_t> const& failing : vector<vector<size_t>>{
+             {}, { 0 }, { size / 2 }, { size - 1 }, { 300, 301, 700 } }) {
+        vector<Moneybag> large = bags, subtracted = others;
+        for (size_t i : failing) {
+            uint64_t const coins[3] = { MAX - i % 3, bags[i].solidus_number(),
+                                        bags[i].denier_number() };
+            large[i] = Moneybag(coins[i % 3], coins[(i + 1) % 3], coins[(i + 2) % 3]);
+            subtracted[i] = Moneybag(0, bags[i].solidus_number() + 1, 0);
+        }
+        MoneybagArray const other_array = array_of(others);
+        MoneybagArray const subtracted_array = array_of(subtracted);
+        // size oznacza, ze zaden element sie nie przepelnia
+        size_t const first = failing.empty() ? size : failing.front();
+
+        check_array_operation(large, first,
+            [&](MoneybagArray& array) { array += other_array; },
+            [&](size_t i) { return large[i].checked_add(others[i]); },
+            [&](MoneybagArray const& array) { return array.overflow_on_add(other_array); });
+        check_array_operation(bags, first,
+            [&](MoneybagArray& array) { array -= subtracted_array; },
+            [&](size_t i) { return bags[i].checked_sub(subtracted[i]); },
+            [&](MoneybagArray const& array) {
+                return array.overflow_on_subtract(subtracted_array);
+            });
+        check_array_operation(large, first,
+            [&](MoneybagArray& array) { array *= 3; },
+            [&](size_t i) { return large[i].checked_mul(3); },
+            [&](MoneybagArray const& array) { return array.overflow_on_scale(3); });
+    }
+
+    MoneybagArray array = array_of(bags);
+    Moneybag total(0, 0, 0);
+    for (Moneybag const& bag : bags)
+        total += bag;
+    CHECK(array.sum() == total);
+    array.set(size - 1, Moneybag(MAX, 0, 0));
+    CHECK(throws_out_of_range([&] { array.sum(); }));
+
+    bool thrown = false;
+    try {
+        array += MoneybagArray(size - 1);
+    }
+    catch (invalid_argument const&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+// Sortowanie pozycyjne daje ten sam porzadek co std::stable_sort po Value,
+// takze dla rownych wartosci zapisanych roznymi monetami
+void test_sort() {
+    auto const by_value = [](Moneybag const& a, Moneybag const& b) {
+        return Value(a) < Value(b);
+    };
+
+    mt19937_64 random(1);
+    for (size_t size : { 0, 1, 2, 1000, 100'000 }) {
+        for (bool full_range : { false, true }) {
+            vector<Moneybag> bags;
+            for (size_t i = 0; i < size; ++i)
+                bags.emplace_back(full_range ? random() : random() % 10,
+                                  full_range ? random() : random() % 40,
+                                  full_range ? random() : random() % 24);
+
+            vector<size_t> radix_order(size), stable_order(size);
+            iota(radix_order.begin(), radix_order.end(), size_t(0));
+            // Indeksy nie musza byc na poczatku uporzadkowane
+            shuffle(radix_order.begin(), radix_order.end(), random);
+            stable_order = radix_order;
+            moneybag_sort::radix_sort_indices(bags, radix_order);
+            stable_sort(stable_order.begin(), stable_order.end(), [&](size_t a, size_t b) {
+                return by_value(bags[a], bags[b]);
+            });
+            CHECK(radix_order == stable_order);
+
+            vector<Moneybag> radix_bags = bags;
+            moneybag_sort::radix_sort(radix_bags);
+            stable_sort(bags.begin(), bags.end(), by_value);
+            CHECK(radix_bags == bags);
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    test_varint();
+    test_value_decimal();
+    test_buffer_round_trip();
+    test_stream_round_trip();
+    test_reduce();
+    test_array();
+    test_sort();
+}
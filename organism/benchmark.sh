@@ -0,0 +1,32 @@
+#!/bin/sh
+# Mierzy czas kompilacji, liczbe instancji szablonow i rozmiar kodu dla serii
+# encounter_series roznej dlugosci, a potem uruchamia benchmark spotkan i tur
+# ekosystemu.
+# Uzycie: ./benchmark.sh [kompilator]   (domyslnie g++)
+set -e
+
+CXX=${1:-g++}
+CXXFLAGS="-std=c++20"
+DIR=$(dirname "$0")
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+printf "%8s %12s %15s %12s\n" length "build [s]" instantiations "text [B]"
+for length in 20 100 500; do
+    start=$(date +%s.%N)
+    $CXX $CXXFLAGS -O2 -DORGANISM_SERIES_LENGTH=$length \
+        -c "$DIR/organism_benchmark.cc" -o "$OUT/series.o"
+    end=$(date +%s.%N)
+    text=$(size "$OUT/series.o" | awk 'NR == 2 { print $1 }')
+
+    # bez optymalizacji kazda instancja szablonu zostaje osobnym symbolem
+    $CXX $CXXFLAGS -O0 -DORGANISM_SERIES_LENGTH=$length \
+        -c "$DIR/organism_benchmark.cc" -o "$OUT/series_O0.o"
+    instantiations=$(nm -C "$OUT/series_O0.o" | grep -c -E ' (encounter|resolve_encounter|encounter_inplace|encounter_series)<' || true)
+
+    printf "%8d %12.2f %15d %12d\n" $length \
+        "$(awk "BEGIN { print $end - $start }")" "$instantiations" "$text"
+done
+
+$CXX $CXXFLAGS -O2 -pthread "$DIR/organism_benchmark.cc" -o "$OUT/organism_benchmark"
+"$OUT/organism_benchmark"
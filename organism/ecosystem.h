@@ -0,0 +1,227 @@
+#ifndef ECOSYSTEM_H
+#define ECOSYSTEM_H
+
+#include "population.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Symulacja populacji na torusie width x height podzielonym na komorki.
+// W kazdej turze:
+//  1. zywe organizmy sa rozkladane do list komorek,
+//  2. w kazdej komorce organizmy sa losowo laczone w pary i spotykaja sie
+//     wedlug zasad encounter(); pary z roznych komorek sa rozlaczne, wiec
+//     komorki przetwarzane sa rownolegle,
+//  3. potomstwo dopisywane jest w kolejnosci komorek do komorki rodzica,
+//  4. kazdy zywy organizm przesuwa sie o co najwyzej jedno pole.
+// Wszystkie losowania zaleza tylko od ziarna, numeru tury i numeru komorki
+// lub organizmu, wiec wynik nie zalezy od liczby watkow.
+class Ecosystem {
+public:
+  using index_t = Population::index_t;
+
+  struct run_stats {
+    uint64_t ticks = 0;
+    uint64_t encounters = 0;
+    double seconds = 0;
+
+    double ticks_per_second() const { return ticks / seconds; }
+    double encounters_per_second() const { return encounters / seconds; }
+  };
+
+  Ecosystem(std::size_t width, std::size_t height, uint64_t seed,
+            std::size_t threads = 0)
+      : width(width), height(height), seed(seed),
+        threads(threads != 0 ? threads
+                             : std::max(1u, std::thread::hardware_concurrency())) {
+    if (width == 0 || height == 0)
+      throw std::invalid_argument("grid can not be empty");
+    if (width > UINT32_MAX / height)
+      throw std::invalid_argument("grid is too large");
+  }
+
+  template <typename... Args>
+  index_t add(std::size_t x, std::size_t y, Args const &...organism) {
+    if (x >= width || y >= height)
+      throw std::out_of_range("position outside of the grid");
+    cell_of.push_back(uint32_t(y * width + x));
+    try {
+      return population.add(organism...);
+    } catch (...) {
+      cell_of.pop_back();
+      throw;
+    }
+  }
+
+  Population const &get_population() const { return population; }
+
+  std::pair<std::size_t, std::size_t> position(index_t i) const {
+    return {cell_of[i] % width, cell_of[i] / width};
+  }
+
+  uint64_t get_tick() const { return tick_number; }
+
+  // Wykonuje jedna ture i zwraca liczbe spotkan
+  uint64_t tick() {
+    build_cells();
+    uint64_t const encounters = encounter_in_cells();
+    move();
+    ++tick_number;
+    return encounters;
+  }
+
+  run_stats run(uint64_t ticks) {
+    run_stats stats;
+    auto const start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < ticks; ++i)
+      stats.encounters += tick();
+    stats.ticks = ticks;
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return stats;
+  }
+
+private:
+  struct child_t {
+    uint32_t cell;
+    Population::species_id_t species;
+    uint64_t vitality;
+    diet_t diet;
+  };
+
+  std::size_t width;
+  std::size_t height;
+  uint64_t seed;
+  std::size_t threads;
+  uint64_t tick_number = 0;
+
+  Population population;
+  std::vector<uint32_t> cell_of;
+  // Listy komorek: zywe organizmy z komorki c to
+  // members[cell_begin[c]] ... members[cell_begin[c + 1] - 1]
+  std::vector<std::size_t> cell_begin;
+  std::vector<index_t> members;
+
+  static constexpr uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  uint64_t random(uint64_t stream, uint64_t object) const {
+    return mix(seed ^ mix(tick_number ^ mix(stream ^ mix(object))));
+  }
+
+  // Ponizej tylu komorek lub organizmow na watek tworzenie watkow kosztuje
+  // wiecej niz praca, ktora moglyby wykonac
+  static constexpr std::size_t MIN_PART = 1 << 12;
+
+  // Wywoluje work(begin, end, part) dla rozlacznych przedzialow [0, count);
+  // male zakresy przetwarzane sa w jednym watku
+  template <typename Work>
+  void parallel_for(std::size_t count, Work work) const {
+    std::size_t const parts =
+        std::max<std::size_t>(1, std::min(threads, count / MIN_PART));
+    std::size_t const part_size = (count + parts - 1) / parts;
+    std::vector<std::thread> workers;
+    workers.reserve(parts - 1);
+    try {
+      for (std::size_t part = 1; part < parts; ++part)
+        workers.emplace_back([&, part] {
+          work(std::min(count, part * part_size),
+               std::min(count, (part + 1) * part_size), part);
+        });
+    } catch (...) {
+      for (auto &worker : workers)
+        worker.join();
+      throw;
+    }
+    work(0, std::min(count, part_size), 0);
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  void build_cells() {
+    std::size_t const cells = width * height;
+    cell_begin.assign(cells + 1, 0);
+    for (index_t i = 0; i < population.size(); ++i)
+      if (!population.is_dead(i))
+        ++cell_begin[cell_of[i] + 1];
+    for (std::size_t c = 0; c < cells; ++c)
+      cell_begin[c + 1] += cell_begin[c];
+
+    members.resize(cell_begin[cells]);
+    std::vector<std::size_t> next(cell_begin.begin(), cell_begin.end() - 1);
+    for (index_t i = 0; i < population.size(); ++i)
+      if (!population.is_dead(i))
+        members[next[cell_of[i]]++] = i;
+  }
+
+  uint64_t encounter_in_cells() {
+    std::size_t const cells = width * height;
+    std::vector<std::vector<child_t>> children(threads);
+    std::vector<uint64_t> encounters(threads, 0);
+
+    parallel_for(cells, [&](std::size_t begin, std::size_t end,
+                            std::size_t part) {
+      for (std::size_t c = begin; c < end; ++c) {
+        index_t *const first = members.data() + cell_begin[c];
+        std::size_t const count = cell_begin[c + 1] - cell_begin[c];
+
+        // losowe skojarzenie w pary: tasowanie Fishera-Yatesa
+        for (std::size_t i = count; i > 1; --i)
+          std::swap(first[i - 1], first[random(c, i) % i]);
+
+        for (std::size_t i = 0; i + 1 < count; i += 2) {
+          index_t const a = first[i], b = first[i + 1];
+          if (population.encounter_pair(a, b))
+            children[part].push_back(
+                {uint32_t(c), population.get_species(a),
+                 (population.get_vitality(a) + population.get_vitality(b)) / 2,
+                 population.get_diet(a)});
+        }
+        encounters[part] += count / 2;
+      }
+    });
+
+    std::size_t born = 0;
+    for (auto const &part_children : children)
+      born += part_children.size();
+    population.reserve(population.size() + born);
+    cell_of.reserve(population.size() + born);
+
+    uint64_t total = 0;
+    for (std::size_t part = 0; part < threads; ++part) {
+      total += encounters[part];
+      for (child_t const &child : children[part]) {
+        population.add(child.species, child.vitality, child.diet);
+        cell_of.push_back(child.cell);
+      }
+    }
+    return total;
+  }
+
+  void move() {
+    parallel_for(population.size(), [&](std::size_t begin, std::size_t end,
+                                         std::size_t) {
+      for (index_t i = begin; i < end; ++i) {
+        if (population.is_dead(i))
+          continue;
+        uint64_t const r = random(UINT64_MAX, i);
+        std::size_t const x = (cell_of[i] % width + width + r % 3 - 1) % width;
+        std::size_t const y =
+            (cell_of[i] / width + height + (r / 3) % 3 - 1) % height;
+        cell_of[i] = uint32_t(y * width + x);
+      }
+    });
+  }
+};
+
+#endif
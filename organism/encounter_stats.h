@@ -0,0 +1,109 @@
+#ifndef ENCOUNTER_STATS_H
+#define ENCOUNTER_STATS_H
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+#ifdef ORGANISM_STATS
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+// Statystyki spotkan w encounter(), encounter_inplace() i encounter_series().
+// Domyslnie wylaczone: record_encounter() jest wtedy pusta funkcja i nic nie
+// kosztuje. Wlacza je zdefiniowanie ORGANISM_STATS przed dolaczeniem
+// organism.h; kazdy watek liczy wtedy we wlasnych licznikach, a
+// encounter_stats() laczy je na zadanie.
+
+enum class encounter_event : uint8_t {
+  dead,        // nic, bo ktorys organizm nie zyje (3.)
+  offspring,   // narodzil sie potomek (4.)
+  nothing,     // nic, bo zaden nie moze zjesc drugiego (5., 7., 8.)
+  mutual_kill, // obaj zgineli w walce (6.)
+  eaten,       // jeden zwierz zjadl drugiego (6., 8.)
+  plant_eaten, // zjedzono rosline (7.)
+};
+
+constexpr std::size_t ENCOUNTER_EVENTS = 6;
+
+using encounter_counts = std::array<uint64_t, ENCOUNTER_EVENTS>;
+
+#ifdef ORGANISM_STATS
+namespace encounter_stats_detail {
+
+struct thread_counters;
+
+struct registry {
+  std::mutex mutex;
+  std::vector<thread_counters *> live;
+  // liczniki watkow, ktore juz sie zakonczyly
+  encounter_counts retired{};
+
+  static registry &get() {
+    static registry instance;
+    return instance;
+  }
+};
+
+struct thread_counters {
+  // Zapisuje tylko wlasny watek, wiec wystarcza zwykly load i store
+  std::array<std::atomic<uint64_t>, ENCOUNTER_EVENTS> counts{};
+
+  thread_counters() {
+    registry &stats = registry::get();
+    std::lock_guard lock(stats.mutex);
+    stats.live.push_back(this);
+  }
+
+  ~thread_counters() {
+    registry &stats = registry::get();
+    std::lock_guard lock(stats.mutex);
+    for (std::size_t i = 0; i < ENCOUNTER_EVENTS; ++i)
+      stats.retired[i] += counts[i].load(std::memory_order_relaxed);
+    stats.live.erase(std::find(stats.live.begin(), stats.live.end(), this));
+  }
+};
+
+inline thread_counters &local() {
+  thread_local thread_counters counters;
+  return counters;
+}
+
+} // namespace encounter_stats_detail
+
+// Suma licznikow wszystkich watkow, indeksowana encounter_event
+inline encounter_counts encounter_stats() {
+  auto &stats = encounter_stats_detail::registry::get();
+  std::lock_guard lock(stats.mutex);
+  encounter_counts result = stats.retired;
+  for (auto const *counters : stats.live)
+    for (std::size_t i = 0; i < ENCOUNTER_EVENTS; ++i)
+      result[i] += counters->counts[i].load(std::memory_order_relaxed);
+  return result;
+}
+
+// Zeruje liczniki; wolno wywolac tylko, gdy zadne spotkanie nie trwa
+inline void reset_encounter_stats() {
+  auto &stats = encounter_stats_detail::registry::get();
+  std::lock_guard lock(stats.mutex);
+  stats.retired = {};
+  for (auto *counters : stats.live)
+    for (auto &count : counters->counts)
+      count.store(0, std::memory_order_relaxed);
+}
+#endif
+
+constexpr void record_encounter([[maybe_unused]] encounter_event event) {
+#ifdef ORGANISM_STATS
+  if (!std::is_constant_evaluated()) {
+    auto &count = encounter_stats_detail::local().counts[std::size_t(event)];
+    count.store(count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  }
+#endif
+}
+
+#endif
@@ -0,0 +1,116 @@
+// Testy statystyk spotkan. Plik kompiluje sie z ORGANISM_STATS i bez niego;
+// stats_test.sh buduje i uruchamia obie wersje oraz sprawdza, ze bez
+// ORGANISM_STATS po licznikach nie zostaje zaden symbol. Sprawdzenia nie
+// zaleza od NDEBUG.
+//
+// g++ -std=c++20 -O2 -pthread -DORGANISM_STATS encounter_stats_test.cc
+// g++ -std=c++20 -O2 -pthread encounter_stats_test.cc
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "organism.h"
+
+using namespace std;
+
+namespace {
+
+constexpr Carnivore<uint32_t> wolf(1, 100);
+constexpr Omnivore<uint32_t> dog(2, 10);
+constexpr Herbivore<uint32_t> elephant(3, 500);
+constexpr Plant<uint32_t> pine(4, 34);
+
+// Po jednym spotkaniu kazdego rodzaju, czyli liczniki { 1, 1, 1, 1, 1, 1 }
+void encounter_each_event() {
+    encounter(wolf, Omnivore<uint32_t>(2, 0));                   // dead
+    encounter(dog, Omnivore<uint32_t>(2, 30));                   // offspring
+    encounter(elephant, Herbivore<uint32_t>(5, 10));             // nothing
+    encounter(Carnivore<uint32_t>(1, 7), Carnivore<uint32_t>(6, 7)); // mutual_kill
+    encounter(wolf, dog);                                        // eaten
+    encounter(elephant, pine);                                   // plant_eaten
+}
+
+// Spotkania liczone w czasie kompilacji nie zmieniaja licznikow
+constexpr uint64_t compile_time_vitality =
+    encounter_series(wolf, dog, pine, elephant).get_vitality();
+
+static_assert(compile_time_vitality == 105);
+
+#ifdef ORGANISM_STATS
+
+void check(bool condition, char const *what, int line) {
+    if (!condition) {
+        fprintf(stderr, "line %d: %s\n", line, what);
+        exit(1);
+    }
+}
+
+#define CHECK(...) check((__VA_ARGS__), #__VA_ARGS__, __LINE__)
+
+encounter_counts counts(uint64_t dead, uint64_t offspring, uint64_t nothing,
+                        uint64_t mutual_kill, uint64_t eaten,
+                        uint64_t plant_eaten) {
+    return {dead, offspring, nothing, mutual_kill, eaten, plant_eaten};
+}
+
+void test_counts() {
+    reset_encounter_stats();
+    CHECK(encounter_stats() == counts(0, 0, 0, 0, 0, 0));
+
+    encounter_each_event();
+    CHECK(encounter_stats() == counts(1, 1, 1, 1, 1, 1));
+
+    // Wilk spotyka martwego psa, sosne, ktorej nie je, psa, ktorego zjada, i
+    // slonia, ktory jest dla niego za silny
+    reset_encounter_stats();
+    auto const dead_dog = Omnivore<uint32_t>(2, 0);
+    CHECK(encounter_series(wolf, dead_dog, pine, dog, elephant).get_vitality() ==
+          compile_time_vitality);
+    CHECK(encounter_stats() == counts(1, 0, 2, 0, 1, 0));
+
+    // Spotkania rosliny z roslinami w serii z zakresu nie sa liczone, a
+    // seria przerywa sie po smierci pierwszego organizmu
+    reset_encounter_stats();
+    vector<AnyOrganism<uint32_t>> const others = {pine, Plant<uint32_t>(4, 1),
+                                                  wolf, dog, elephant};
+    CHECK(encounter_series(Plant<uint32_t>(7, 5), others).get_vitality() == 5);
+    CHECK(encounter_stats() == counts(0, 0, 3, 0, 0, 0));
+    reset_encounter_stats();
+    CHECK(encounter_series(Herbivore<uint32_t>(3, 10), others).is_dead());
+    CHECK(encounter_stats() == counts(0, 0, 0, 0, 1, 2));
+}
+
+// Liczniki zakonczonych watkow i watku glownego sa sumowane
+void test_threads() {
+    reset_encounter_stats();
+    vector<thread> workers;
+    for (int t = 0; t < 4; ++t)
+        workers.emplace_back([] {
+            for (int i = 0; i < 1000; ++i)
+                encounter_each_event();
+        });
+    for (thread &worker : workers)
+        worker.join();
+
+    thread running([] { encounter_each_event(); });
+    running.join();
+    encounter_each_event();
+    CHECK(encounter_stats() == counts(4002, 4002, 4002, 4002, 4002, 4002));
+
+    reset_encounter_stats();
+    CHECK(encounter_stats() == counts(0, 0, 0, 0, 0, 0));
+}
+
+#endif
+
+} // namespace
+
+int main() {
+    // Bez ORGANISM_STATS spotkania dzialaja tak samo, tylko nie sa liczone
+    encounter_each_event();
+#ifdef ORGANISM_STATS
+    test_counts();
+    test_threads();
+#endif
+}
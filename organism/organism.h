@@ -1,12 +1,18 @@
 #ifndef ORGANISM_H
 #define ORGANISM_H
 
+#include <array>
 #include <concepts>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <optional>
+#include <ranges>
 #include <string>
 #include <tuple>
+#include <variant>
+
+#include "encounter_stats.h"
 
 template <std::equality_comparable species_t, bool can_eat_meat,
           bool can_eat_plants>
@@ -21,7 +27,7 @@ public:
 
   constexpr uint64_t get_vitality() const { return vitality; };
 
-  constexpr species_t get_species() const { return species; }
+  constexpr species_t const &get_species() const { return species; }
 
   constexpr bool is_dead() const { return vitality == 0; }
 };
@@ -33,6 +39,145 @@ template <typename species_t>
 using Herbivore = Organism<species_t, false, true>;
 template <typename species_t> using Plant = Organism<species_t, false, false>;
 
+// Sposob odzywiania zakodowany jako (je_mieso << 1) | je_rosliny
+enum class diet_t : uint8_t {
+  plant = 0,
+  herbivore = 1,
+  carnivore = 2,
+  omnivore = 3
+};
+
+template <bool can_eat_meat, bool can_eat_plants>
+constexpr diet_t diet_of =
+    diet_t((can_eat_meat ? 2 : 0) | (can_eat_plants ? 1 : 0));
+
+// Rodzaj spotkania dwoch zywych organizmow
+enum class outcome_t : uint8_t {
+  none,        // nic sie nie dzieje (5.)
+  offspring,   // rodzi sie potomek (4.)
+  fight,       // walka miesozercow (6.)
+  one_way,     // silniejszy moze zjesc slabszego, jesli potrafi (8.)
+  plant_eaten, // pierwszy zjada rosline (7.)
+};
+
+struct encounter_rule {
+  outcome_t same_species;
+  outcome_t other_species;
+  // dla one_way: czy pierwszy moze zjesc drugiego i odwrotnie
+  bool first_eats;
+  bool second_eats;
+};
+
+constexpr encounter_rule make_encounter_rule(diet_t diet1, diet_t diet2) {
+  bool const sp1_eats_m = unsigned(diet1) & 2, sp1_eats_p = unsigned(diet1) & 1;
+  bool const sp2_eats_m = unsigned(diet2) & 2, sp2_eats_p = unsigned(diet2) & 1;
+
+  if (diet1 == diet_t::plant && diet2 == diet_t::plant)
+    // rosliny sie nie spotykaja
+    return {outcome_t::none, outcome_t::none, false, false};
+  if (diet1 == diet2) // zgodne preferencje zywieniowe (1.)
+    return {outcome_t::offspring,
+            sp1_eats_m ? outcome_t::fight : outcome_t::none, false, false};
+  if (diet1 == diet_t::plant || diet2 == diet_t::plant) { // (7.)
+    // roslina jest zjadana tylko, gdy jest druga
+    outcome_t const outcome = diet2 == diet_t::plant && sp1_eats_p
+                                  ? outcome_t::plant_eaten
+                                  : outcome_t::none;
+    return {outcome, outcome, false, false};
+  }
+  if (sp1_eats_m && sp2_eats_m) // miesozerca i wszystkozerca (6.)
+    return {outcome_t::fight, outcome_t::fight, false, false};
+  return {outcome_t::one_way, outcome_t::one_way, !sp1_eats_p, !sp2_eats_p};
+}
+
+// Zasady spotkan dla wszystkich 16 par diet, indeksowane 4 * dieta1 + dieta2
+constexpr auto ENCOUNTER_RULES = [] {
+  std::array<encounter_rule, 16> rules{};
+  for (unsigned i = 0; i < 16; ++i)
+    rules[i] = make_encounter_rule(diet_t(i / 4), diet_t(i % 4));
+  return rules;
+}();
+
+constexpr encounter_rule const &rule_for(diet_t diet1, diet_t diet2) {
+  return ENCOUNTER_RULES[4 * unsigned(diet1) + unsigned(diet2)];
+}
+
+// Wykonuje spotkanie, zmieniajac witalnosc organism1 oraz vitality2
+// (witalnosc organism2 czytana jest tylko z vitality2). Zwraca, czy
+// organizmy wydaja potomstwo.
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, bool sp2_eats_m,
+          bool sp2_eats_p>
+  requires(sp1_eats_m || sp1_eats_p || sp2_eats_m || sp2_eats_p)
+constexpr bool
+resolve_encounter(Organism<species_t, sp1_eats_m, sp1_eats_p> &organism1,
+                  Organism<species_t, sp2_eats_m, sp2_eats_p> const &organism2,
+                  uint64_t &vitality2) {
+  constexpr encounter_rule rule =
+      rule_for(diet_of<sp1_eats_m, sp1_eats_p>, diet_of<sp2_eats_m, sp2_eats_p>);
+  uint64_t &vitality1 = organism1.vitality;
+
+  if (vitality1 == 0 || vitality2 == 0) { // jezeli ktorys nie zyje (3.)
+    record_encounter(encounter_event::dead);
+    return false;
+  }
+
+  outcome_t outcome = rule.other_species;
+  // gatunki porownujemy tylko wtedy, gdy ma to znaczenie
+  if constexpr (rule.same_species != rule.other_species) {
+    if (organism1.get_species() == organism2.get_species())
+      outcome = rule.same_species;
+  }
+
+  switch (outcome) {
+  case outcome_t::offspring:
+    record_encounter(encounter_event::offspring);
+    return true;
+  case outcome_t::plant_eaten:
+    record_encounter(encounter_event::plant_eaten);
+    vitality1 += vitality2;
+    vitality2 = 0;
+    break;
+  case outcome_t::fight:
+  case outcome_t::one_way: {
+    bool const fight = outcome == outcome_t::fight;
+    if (vitality1 > vitality2 && (fight || rule.first_eats)) {
+      record_encounter(encounter_event::eaten);
+      vitality1 += vitality2 / 2;
+      vitality2 = 0;
+    } else if (vitality1 < vitality2 && (fight || rule.second_eats)) {
+      record_encounter(encounter_event::eaten);
+      vitality2 += vitality1 / 2;
+      vitality1 = 0;
+    } else if (vitality1 == vitality2 && fight) {
+      record_encounter(encounter_event::mutual_kill);
+      vitality1 = 0;
+      vitality2 = 0;
+    } else
+      record_encounter(encounter_event::nothing);
+    break;
+  }
+  case outcome_t::none:
+    record_encounter(encounter_event::nothing);
+    break;
+  }
+  return false;
+}
+
+// Spotkanie zmieniajace organizmy w miejscu, bez kopiowania ich gatunkow.
+// Zwraca potomka, jesli sie narodzil.
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, bool sp2_eats_m,
+          bool sp2_eats_p>
+  requires(sp1_eats_m || sp1_eats_p || sp2_eats_m || sp2_eats_p)
+constexpr std::optional<Organism<species_t, sp1_eats_m, sp1_eats_p>>
+encounter_inplace(Organism<species_t, sp1_eats_m, sp1_eats_p> &organism1,
+                  Organism<species_t, sp2_eats_m, sp2_eats_p> &organism2) {
+  if (resolve_encounter(organism1, organism2, organism2.vitality))
+    return std::optional<Organism<species_t, sp1_eats_m, sp1_eats_p>>(
+        std::in_place, organism1.get_species(),
+        (organism1.get_vitality() + organism2.get_vitality()) / 2);
+  return std::nullopt;
+}
+
 template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, bool sp2_eats_m,
           bool sp2_eats_p>
   requires(sp1_eats_m || sp1_eats_p || sp2_eats_m || sp2_eats_p)
@@ -41,108 +186,72 @@ constexpr std::tuple<Organism<species_t, sp1_eats_m, sp1_eats_p>,
                      std::optional<Organism<species_t, sp1_eats_m, sp1_eats_p>>>
 encounter(Organism<species_t, sp1_eats_m, sp1_eats_p> organism1,
           Organism<species_t, sp2_eats_m, sp2_eats_p> organism2) {
-  if (organism1.is_dead() ||
-      organism2.is_dead()) { // jezeli ktorys nie zyje (3.)
-    return {organism1, organism2, {}};
-  }
-  if constexpr (sp1_eats_m == sp2_eats_m && sp1_eats_p == sp2_eats_p) {
-    // jezeli sa zgodne preferencje
-    // zywieniowe (1.)
-    if (organism1.get_species() == organism2.get_species())
-      // spotkanie dwoch zwierzat tego samego gatunku (4.)
-      return {organism1,
-              organism2,
-              {organism1.get_species(),
-               (organism1.get_vitality() + organism2.get_vitality()) / 2}};
-    else {
-      if (sp1_eats_m) { // jezeli obaj sa miesozerni lub wszystkozerni (6.)
-        if (organism1.get_vitality() > organism2.get_vitality())
-          return {{organism1.get_species(),
-                   (organism1.get_vitality() + organism2.get_vitality() / 2)},
-                  {organism2.get_species(), 0},
-                  {}};
-        else if (organism1.get_vitality() == organism2.get_vitality())
-          return {
-              {organism1.get_species(), 0}, {organism2.get_species(), 0}, {}};
-        else
-          return {{organism1.get_species(), 0},
-                  {organism2.get_species(),
-                   (organism2.get_vitality() + organism1.get_vitality() / 2)},
-                  {}};
-      } else // jezeli obaj sa roslinozerni (5.)
-        return {organism1, organism2, {}};
-    }
-  } else if ((!sp1_eats_m && !sp1_eats_p) ||
-             (!sp2_eats_m &&
-              !sp2_eats_p)) { // jezeli jeden z nich jest roslina (7.)
-    // jesli drugi jest roslina
-    if (sp1_eats_p) // jesli pierwszy jest roslinozerca lub wszystkozerca
-      return {{organism1.get_species(),
-               (organism1.get_vitality() + organism2.get_vitality())},
-              {organism2.get_species(), 0},
-              {}};
-    else // jesli pierwszy jest miesozerca
-      return {organism1, organism2, {}};
-    // jesli pierwszy jest roslina
-    if (sp2_eats_p) // jesli drugi jest roslinozerca lub wszystkozerca
-      return {{organism1.get_species(), 0},
-              {organism2.get_species(),
-               (organism1.get_vitality() + organism2.get_vitality())},
-              {}};
-    else // jesli drugi jest miesozerca
-      return {organism1, organism2, {}};
-  } else { // jesli zaden z nich nie jest roslina i nie maja zgodnych
-           // preferencji zywieniowych
-    if (sp1_eats_m && sp2_eats_m) { // spotyknie miesozercy i wszystkozercy (6.)
-      if (organism1.get_vitality() > organism2.get_vitality())
-        return {{organism1.get_species(),
-                 (organism1.get_vitality() + organism2.get_vitality() / 2)},
-                {organism2.get_species(), 0},
-                {}};
-      else if (organism1.get_vitality() == organism2.get_vitality())
-        return {{organism1.get_species(), 0}, {organism2.get_species(), 0}, {}};
-      else
-        return {{organism1.get_species(), 0},
-                {organism2.get_species(),
-                 (organism2.get_vitality() + organism1.get_vitality() / 2)},
-                {}};
-    } else { // jezeli zdolnosc konsumpcji zachodzi w jedna strone (8.)
-      if (organism1.get_vitality() > organism2.get_vitality()) {
-        if (sp1_eats_p) // jezeli drugi jest roslinozerca
-          return {organism1, organism2, {}};
-        else
-          return {{organism1.get_species(),
-                   (organism1.get_vitality() + organism2.get_vitality() / 2)},
-                  {organism2.get_species(), 0},
-                  {}};
-      } else if (organism1.get_vitality() == organism2.get_vitality())
-        return {organism1, organism2, {}};
-      else {
-        if (sp2_eats_p) // jezeli pierwszy jest roslinozerca
-          return {organism1, organism2, {}};
-        else
-          return {{organism1.get_species(), 0},
-                  {organism2.get_species(),
-                   (organism2.get_vitality() + organism1.get_vitality() / 2)},
-                  {}};
-      }
-    }
+  auto child = encounter_inplace(organism1, organism2);
+  return {organism1, organism2, std::move(child)};
+}
+
+// Organizm dowolnego rodzaju, gdy dieta znana jest dopiero w czasie dzialania
+template <typename species_t>
+using AnyOrganism = std::variant<Carnivore<species_t>, Omnivore<species_t>,
+                                 Herbivore<species_t>, Plant<species_t>>;
+
+// Jedno spotkanie w serii: zmienia sie tylko witalnosc pierwszego organizmu.
+// Roslina spotykajaca rosline nic nie robi.
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p,
+          typename Organism2>
+constexpr void
+encounter_in_series(Organism<species_t, sp1_eats_m, sp1_eats_p> &organism1,
+                    Organism2 const &organism2) {
+  if constexpr (requires { encounter(organism1, organism2); }) {
+    uint64_t vitality2 = organism2.get_vitality();
+    resolve_encounter(organism1, organism2, vitality2);
   }
 }
 
-template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, typename Arg1,
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p,
           typename... Args>
+  requires(sizeof...(Args) > 0)
 constexpr Organism<species_t, sp1_eats_m, sp1_eats_p>
 encounter_series(Organism<species_t, sp1_eats_m, sp1_eats_p> organism1,
-                 Arg1 arg1, Args... args) {
-  return encounter_series(encounter_series(organism1, arg1), args...);
+                 Args... args) {
+  (resolve_encounter(organism1, args, args.vitality), ...);
+  return organism1;
 }
 
-template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, typename Arg>
+// Seria spotkan o dlugosci znanej dopiero w czasie dzialania programu.
+// Przerywa sie, gdy pierwszy organizm zginie.
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p,
+          std::ranges::input_range Range>
+  requires std::convertible_to<std::ranges::range_reference_t<Range>,
+                               AnyOrganism<species_t> const &>
 constexpr Organism<species_t, sp1_eats_m, sp1_eats_p>
 encounter_series(Organism<species_t, sp1_eats_m, sp1_eats_p> organism1,
-                 Arg arg) {
-  return std::get<0>(encounter(organism1, arg));
+                 Range &&others) {
+  // Zycie sprawdzane jest przed odczytem elementu, wiec z zakresu
+  // wejsciowego nie sa czytane organizmy po smierci pierwszego
+  auto const end = std::ranges::end(others);
+  for (auto it = std::ranges::begin(others); it != end && !organism1.is_dead();
+       ++it) {
+    AnyOrganism<species_t> const &other = *it;
+    std::visit(
+        [&organism1](auto const &organism2) {
+          encounter_in_series(organism1, organism2);
+        },
+        other);
+  }
+  return organism1;
+}
+
+template <typename species_t, std::ranges::input_range Range>
+  requires std::convertible_to<std::ranges::range_reference_t<Range>,
+                               AnyOrganism<species_t> const &>
+constexpr AnyOrganism<species_t>
+encounter_series(AnyOrganism<species_t> const &organism1, Range &&others) {
+  return std::visit(
+      [&others](auto const &organism) -> AnyOrganism<species_t> {
+        return encounter_series(organism, std::forward<Range>(others));
+      },
+      organism1);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+#include "ecosystem.h"
+#include "organism.h"
+#include "species_registry.h"
+
+using namespace std;
+
+// Dlugosc serii liczonej w czasie kompilacji; benchmark.sh kompiluje ten plik
+// dla kilku wartosci i porownuje czas budowania oraz rozmiar kodu.
+#ifndef ORGANISM_SERIES_LENGTH
+#define ORGANISM_SERIES_LENGTH 20
+#endif
+
+namespace {
+
+constexpr size_t ITERATIONS = 1'000'000;
+
+// Kolejne organizmy serii maja rozne diety i witalnosci
+template <size_t I> constexpr auto series_member() {
+    if constexpr (I % 3 == 0)
+        return Herbivore<int>(int(I % 7), I % 11);
+    else if constexpr (I % 3 == 1)
+        return Plant<int>(int(I % 5), I % 13);
+    else
+        return Omnivore<int>(int(I % 3), I % 17);
+}
+
+template <size_t... I>
+constexpr uint64_t series_result(index_sequence<I...>) {
+    return encounter_series(Carnivore<int>(100, 1'000'000), series_member<I>()...)
+        .get_vitality();
+}
+
+static_assert(series_result(make_index_sequence<ORGANISM_SERIES_LENGTH>()) > 0);
+
+template <typename species_t> species_t species_of(size_t i);
+
+template <> uint8_t species_of<uint8_t>(size_t i) { return uint8_t(i % 4); }
+
+template <> uint64_t species_of<uint64_t>(size_t i) { return i % 4; }
+
+template <> string species_of<string>(size_t i) {
+    return string(32, 'a') + char('a' + i % 4);
+}
+
+template <> SpeciesId<string> species_of<SpeciesId<string>>(size_t i) {
+    return SpeciesId<string>(uint32_t(i % 4));
+}
+
+// Srednia liczba nanosekund na spotkanie. encounter_inplace zmienia
+// organizmy w miejscu, a encounter() przyjmuje i zwraca ich kopie.
+template <bool inplace, typename first_t, typename second_t>
+double time_encounters(vector<first_t> &first, vector<second_t> &second,
+                       uint64_t &checksum) {
+    auto const start = chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; ++i) {
+        auto &organism1 = first[i % first.size()];
+        auto &organism2 = second[(i * 7) % second.size()];
+        if constexpr (inplace) {
+            uint64_t const vitality1 = organism1.vitality;
+            uint64_t const vitality2 = organism2.vitality;
+            auto child = encounter_inplace(organism1, organism2);
+            checksum += organism1.get_vitality() + organism2.get_vitality() +
+                        child.has_value();
+            // przywracamy witalnosci, zeby kazde spotkanie bylo takie samo
+            organism1.vitality = vitality1;
+            organism2.vitality = vitality2;
+        } else {
+            auto const [after1, after2, child] = encounter(organism1, organism2);
+            checksum += after1.get_vitality() + after2.get_vitality() +
+                        child.has_value();
+        }
+    }
+    chrono::duration<double, nano> const elapsed =
+        chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+template <typename species_t, bool m1, bool p1, bool m2, bool p2>
+void benchmark_pair(char const *species_name) {
+    if constexpr (m1 || p1 || m2 || p2) {
+        vector<Organism<species_t, m1, p1>> first;
+        vector<Organism<species_t, m2, p2>> second;
+        for (size_t i = 0; i < 1024; ++i) {
+            first.emplace_back(species_of<species_t>(i), 10 + i % 7);
+            second.emplace_back(species_of<species_t>(i / 3), 10 + i % 5);
+        }
+
+        uint64_t inplace_checksum = 0, copying_checksum = 0;
+        double const inplace = time_encounters<true>(first, second, inplace_checksum);
+        double const copying = time_encounters<false>(first, second, copying_checksum);
+        if (inplace_checksum != copying_checksum) {
+            fprintf(stderr, "encounter() differs from encounter_inplace\n");
+            exit(1);
+        }
+
+        printf("%-10s %d%d vs %d%d  inplace %8.2f ns  encounter() %8.2f ns  (%lu)\n",
+               species_name, m1, p1, m2, p2, inplace, copying,
+               (unsigned long)inplace_checksum);
+    }
+}
+
+template <typename species_t, bool m1, bool p1>
+void benchmark_row(char const *species_name) {
+    benchmark_pair<species_t, m1, p1, false, false>(species_name);
+    benchmark_pair<species_t, m1, p1, false, true>(species_name);
+    benchmark_pair<species_t, m1, p1, true, false>(species_name);
+    benchmark_pair<species_t, m1, p1, true, true>(species_name);
+}
+
+template <typename species_t> void benchmark_species(char const *species_name) {
+    benchmark_row<species_t, false, false>(species_name);
+    benchmark_row<species_t, false, true>(species_name);
+    benchmark_row<species_t, true, false>(species_name);
+    benchmark_row<species_t, true, true>(species_name);
+}
+
+// Tury Ecosystem na planszach roznej wielkosci, po 4 organizmy na komorke.
+// Kazdy organizm jest roslinozerca innego gatunku, wiec nikt nie ginie i nie
+// rodzi sie, a kazda tura ma tyle samo spotkan.
+void benchmark_ecosystem() {
+    size_t const hardware_threads = max(1u, thread::hardware_concurrency());
+    for (size_t side : {8, 32, 256}) {
+        for (size_t threads : {size_t(1), hardware_threads}) {
+            Ecosystem ecosystem(side, side, 1, threads);
+            for (size_t i = 0; i < 4 * side * side; ++i)
+                ecosystem.add(i % side, i / side % side,
+                              Herbivore<uint32_t>(uint32_t(i), 10 + i % 7));
+            Ecosystem::run_stats const stats =
+                ecosystem.run(side >= 256 ? 20 : 2000);
+            printf("ecosystem %3zux%-3zu %2zu threads  %10.1f ticks/s  "
+                   "%8.2f M encounters/s\n",
+                   side, side, threads, stats.ticks_per_second(),
+                   stats.encounters_per_second() / 1e6);
+            if (threads == hardware_threads)
+                break;
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    printf("series of %d organisms evaluated at compile time: %lu\n",
+           ORGANISM_SERIES_LENGTH,
+           (unsigned long)series_result(make_index_sequence<ORGANISM_SERIES_LENGTH>()));
+
+    // Diety zapisane jako (je_mieso, je_rosliny)
+    benchmark_species<uint8_t>("uint8_t");
+    benchmark_species<uint64_t>("uint64_t");
+    benchmark_species<string>("string");
+    benchmark_species<SpeciesId<string>>("SpeciesId");
+
+    benchmark_ecosystem();
+}
@@ -1,5 +1,12 @@
+#include <cassert>
+#include <ranges>
+#include <stdexcept>
 #include <string>
+#include <vector>
+#include "ecosystem.h"
 #include "organism.h"
+#include "population.h"
+#include "species_registry.h"
 
 using namespace std;
 using species_id_t = uint8_t;
@@ -9,6 +16,225 @@ const species_id_t wolf_id = 2;
 const species_id_t pine_id = 3;
 const species_id_t elephant_id = 4;
 
+// Sprawdza, czy spotkanie w Population daje ten sam wynik co encounter().
+template <bool m1, bool p1, bool m2, bool p2>
+void check_population_encounter(uint64_t v1, uint64_t v2) {
+    Organism<species_id_t, m1, p1> organism1(dog_id, v1);
+    Organism<species_id_t, m2, p2> organism2(m1 == m2 && p1 == p2 ? dog_id : wolf_id, v2);
+    auto [result1, result2, child] = encounter(organism1, organism2);
+
+    Population population;
+    population.add(organism1);
+    population.add(organism2);
+    const pair<size_t, size_t> pair_of_organisms(0, 1);
+    assert(population.encounter({&pair_of_organisms, 1}) == child.has_value());
+    assert(population.get_vitality(0) == result1.get_vitality());
+    assert(population.get_vitality(1) == result2.get_vitality());
+    if (child.has_value())
+        assert(population.get_vitality(2) == child->get_vitality());
+}
+
+// Rodzic wystepuje w dwoch parach: potomek dostaje witalnosc rodzicow z chwili
+// spotkania, a nie z konca calej serii.
+void check_population_parent_in_two_pairs() {
+    Omnivore<species_id_t> dog1(dog_id, 10);
+    Omnivore<species_id_t> dog2(dog_id, 30);
+    Carnivore<species_id_t> wolf(wolf_id, 100);
+    auto [dog1_result, dog2_result, child] = encounter(dog1, dog2);
+    auto [wolf_result, dog1_eaten, no_child] = encounter(wolf, dog1_result);
+    assert(child.has_value() && !no_child.has_value());
+
+    Population population;
+    population.add(dog1);
+    population.add(dog2);
+    population.add(wolf);
+    const pair<size_t, size_t> pairs[] = {{0, 1}, {2, 0}};
+    assert(population.encounter(pairs) == 1);
+    assert(population.get_vitality(0) == dog1_eaten.get_vitality());
+    assert(population.get_vitality(1) == dog2_result.get_vitality());
+    assert(population.get_vitality(2) == wolf_result.get_vitality());
+    assert(population.get_vitality(3) == child->get_vitality());
+}
+
+// Seria z zakresu daje ten sam wynik co seria o dlugosci znanej w czasie
+// kompilacji, a po smierci pierwszego organizmu nie czyta juz dalszych.
+constexpr bool range_series_matches_fold() {
+    Carnivore<species_id_t> const wolf(wolf_id, 100);
+    Omnivore<species_id_t> const dog(dog_id, 10);
+    Plant<species_id_t> const pine(pine_id, 34);
+    Herbivore<species_id_t> const elephant(elephant_id, 500);
+    Carnivore<species_id_t> const bear(dog_id, 1000);
+
+    vector<AnyOrganism<species_id_t>> const others = {dog, pine, elephant, dog, wolf};
+    if (encounter_series(wolf, others).get_vitality() !=
+        encounter_series(wolf, dog, pine, elephant, dog, wolf).get_vitality())
+        return false;
+
+    vector<AnyOrganism<species_id_t>> const deadly = {dog, bear, wolf, pine};
+    Omnivore<species_id_t> const survivor = encounter_series(dog, deadly);
+    return survivor.is_dead() &&
+           survivor.get_vitality() == encounter_series(dog, dog, bear, wolf, pine).get_vitality();
+}
+
+static_assert(range_series_matches_fold());
+
+void check_range_series_stops() {
+    Herbivore<species_id_t> const goat(dog_id, 10);
+    vector<AnyOrganism<species_id_t>> const others = {
+        Plant<species_id_t>(pine_id, 5), Carnivore<species_id_t>(wolf_id, 100),
+        Plant<species_id_t>(pine_id, 7), Herbivore<species_id_t>(dog_id, 3)};
+
+    size_t read = 0;
+    auto const counted = others | views::transform([&](auto const &other) -> auto const & {
+        ++read;
+        return other;
+    });
+    auto const result = encounter_series(goat, counted);
+    assert(result.is_dead());
+    assert(read == 2);
+    assert(result.get_vitality() ==
+           encounter_series(goat, Plant<species_id_t>(pine_id, 5),
+                            Carnivore<species_id_t>(wolf_id, 100),
+                            Plant<species_id_t>(pine_id, 7),
+                            Herbivore<species_id_t>(dog_id, 3))
+               .get_vitality());
+
+    // Zywy organizm spotyka wszystkie; roslina nie spotyka innych roslin
+    read = 0;
+    Carnivore<species_id_t> const wolf(wolf_id, 1000);
+    assert(encounter_series(wolf, counted).get_vitality() ==
+           encounter_series(wolf, Plant<species_id_t>(pine_id, 5),
+                            Carnivore<species_id_t>(wolf_id, 100),
+                            Plant<species_id_t>(pine_id, 7),
+                            Herbivore<species_id_t>(dog_id, 3))
+               .get_vitality());
+    assert(read == others.size());
+    assert(encounter_series(Plant<species_id_t>(pine_id, 1), others).get_vitality() == 1);
+}
+
+// Gatunek, ktorego nie mozna haszowac, wiec SpeciesRegistry szuka go liniowo
+struct named_species {
+    string name;
+
+    bool operator==(named_species const &) const = default;
+};
+
+static_assert(hashable_species<string>);
+static_assert(!hashable_species<named_species>);
+
+// intern nadaje kazdemu gatunkowi jeden identyfikator, find nie dodaje
+// gatunkow, a get zwraca gatunek o danym identyfikatorze.
+template <typename species_t, typename Make>
+void check_species_registry(vector<species_t> const &species, species_t const &unknown,
+                            Make make_species) {
+    SpeciesRegistry<species_t> registry;
+    assert(!registry.find(species[0]).has_value());
+
+    vector<SpeciesId<species_t>> ids;
+    for (species_t const &one : species)
+        ids.push_back(registry.intern(one));
+    species_t const &first = registry.get(ids[0]);
+
+    for (size_t i = 0; i < species.size(); ++i) {
+        assert(ids[i].get_id() == i);
+        assert(registry.intern(species[i]) == ids[i]);
+        assert(registry.find(species[i]) == ids[i]);
+        assert(registry.get(ids[i]) == species[i]);
+    }
+    assert(registry.size() == species.size());
+
+    assert(!registry.find(unknown).has_value());
+    assert(registry.size() == species.size());
+    bool thrown = false;
+    try {
+        registry.get(SpeciesId<species_t>(uint32_t(species.size())));
+    } catch (out_of_range const &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Kolejne gatunki nie uniewazniaja wczesniej zwroconych referencji
+    SpeciesId<species_t> const unknown_id = registry.intern(unknown);
+    assert(unknown_id.get_id() == species.size());
+    for (size_t i = 0; i < 1000; ++i)
+        assert(registry.intern(make_species(i)).get_id() == species.size() + 1 + i);
+    assert(&registry.get(ids[0]) == &first && first == species[0]);
+    assert(registry.get(unknown_id) == unknown);
+    assert(registry.find(make_species(999)).has_value());
+}
+
+void check_species_registries() {
+    check_species_registry<string>({"dog", "wolf", "pine", string(100, 'x')}, "elephant",
+                                   [](size_t i) { return "species " + to_string(i); });
+    check_species_registry<named_species>(
+        {{"dog"}, {"wolf"}, {"pine"}}, {"elephant"},
+        [](size_t i) { return named_species{"species " + to_string(i)}; });
+}
+
+// Stan ekosystemu po kilku turach: witalnosci, gatunki, diety i pozycje
+// wszystkich organizmow oraz liczby spotkan w kolejnych turach.
+struct ecosystem_state {
+    vector<uint64_t> vitality;
+    vector<uint32_t> species;
+    vector<diet_t> diet;
+    vector<pair<size_t, size_t>> position;
+    vector<uint64_t> encounters;
+
+    bool operator==(ecosystem_state const &) const = default;
+};
+
+ecosystem_state run_ecosystem(size_t side, size_t threads) {
+    Ecosystem ecosystem(side, side, 2024, threads);
+    for (size_t i = 0; i < 3 * side * side; ++i) {
+        size_t const x = i * 7 % side, y = i * 13 / 5 % side;
+        uint32_t const species = uint32_t(i % 5);
+        uint64_t const vitality = 10 + i % 23;
+        switch (i % 4) {
+        case 0: ecosystem.add(x, y, Carnivore<uint32_t>(species, vitality)); break;
+        case 1: ecosystem.add(x, y, Omnivore<uint32_t>(species, vitality)); break;
+        case 2: ecosystem.add(x, y, Herbivore<uint32_t>(species, vitality)); break;
+        case 3: ecosystem.add(x, y, Plant<uint32_t>(species, vitality)); break;
+        }
+    }
+
+    ecosystem_state state;
+    for (int tick = 0; tick < 6; ++tick)
+        state.encounters.push_back(ecosystem.tick());
+    Population const &population = ecosystem.get_population();
+    for (size_t i = 0; i < population.size(); ++i) {
+        state.vitality.push_back(population.get_vitality(i));
+        state.species.push_back(population.get_species(i));
+        state.diet.push_back(population.get_diet(i));
+        state.position.push_back(ecosystem.position(i));
+    }
+    return state;
+}
+
+// Wynik symulacji nie zalezy od liczby watkow, zarowno dla malej planszy
+// liczonej w jednym watku, jak i dla duzej, dzielonej miedzy watki.
+void check_ecosystem_threads() {
+    for (size_t side : {8, 128}) {
+        ecosystem_state const serial = run_ecosystem(side, 1);
+        assert(serial.vitality.size() > 3 * side * side);
+        for (size_t threads : {2, 8})
+            assert(run_ecosystem(side, threads) == serial);
+    }
+}
+
+// Gatunki szersze niz 32 bity nie moga byc dodane bezposrednio, bo po
+// obcieciu gatunki 1 i 1 + 2^32 bylyby tym samym gatunkiem.
+template <typename species_t>
+constexpr bool population_accepts =
+    requires(Population population, Omnivore<species_t> organism) {
+        population.add(organism);
+    };
+
+static_assert(population_accepts<uint8_t>);
+static_assert(population_accepts<uint32_t>);
+static_assert(!population_accepts<uint64_t>);
+static_assert(!population_accepts<int64_t>);
+static_assert(!population_accepts<double>);
+
 int main() {
     // Przykład użycia funkcji encounter: wilk zjada psa.
     constexpr Omnivore<species_id_t> dog(dog_id, 10);
@@ -37,4 +263,15 @@ int main() {
 
     // Funkcja get_species() powinna zwracać gatunek.
     static_assert(wolf.get_species() == wolf_id);
+
+    // Populacja z dieta wybierana w czasie dzialania stosuje te same zasady.
+    check_population_encounter<true, false, true, true>(100, 10);
+    check_population_encounter<true, false, false, true>(100, 10);
+    check_population_encounter<false, true, false, false>(10, 34);
+    check_population_encounter<true, true, true, true>(10, 30);
+    check_population_encounter<false, true, true, false>(10, 30);
+    check_population_parent_in_two_pairs();
+    check_range_series_stops();
+    check_species_registries();
+    check_ecosystem_threads();
 }
@@ -0,0 +1,130 @@
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include "organism.h"
+#include "species_registry.h"
+
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Populacja organizmow o diecie wybieranej w czasie dzialania programu.
+// Witalnosc, identyfikator gatunku i dieta trzymane sa w osobnych tablicach.
+class Population {
+public:
+  using species_id_t = uint32_t;
+  using index_t = std::size_t;
+
+  std::size_t size() const { return vitality.size(); }
+
+  void reserve(std::size_t capacity) {
+    vitality.reserve(capacity);
+    species.reserve(capacity);
+    diet.reserve(capacity);
+  }
+
+  index_t add(species_id_t species_id, uint64_t organism_vitality,
+              diet_t organism_diet) {
+    vitality.push_back(organism_vitality);
+    try {
+      species.push_back(species_id);
+      try {
+        diet.push_back(organism_diet);
+      } catch (...) {
+        species.pop_back();
+        throw;
+      }
+    } catch (...) {
+      vitality.pop_back();
+      throw;
+    }
+    return size() - 1;
+  }
+
+  // Gatunki szersze niz species_id_t zlewalyby sie po obcieciu; takie trzeba
+  // najpierw ponumerowac w SpeciesRegistry
+  template <std::unsigned_integral species_t, bool can_eat_meat,
+            bool can_eat_plants>
+    requires(sizeof(species_t) <= sizeof(species_id_t))
+  index_t add(Organism<species_t, can_eat_meat, can_eat_plants> const &organism) {
+    return add(species_id_t(organism.get_species()), organism.get_vitality(),
+               diet_of<can_eat_meat, can_eat_plants>);
+  }
+
+  template <typename species_t, bool can_eat_meat, bool can_eat_plants>
+  index_t add(Organism<SpeciesId<species_t>, can_eat_meat, can_eat_plants> const
+                  &organism) {
+    return add(organism.get_species().get_id(), organism.get_vitality(),
+               diet_of<can_eat_meat, can_eat_plants>);
+  }
+
+  uint64_t get_vitality(index_t i) const { return vitality[i]; }
+
+  species_id_t get_species(index_t i) const { return species[i]; }
+
+  diet_t get_diet(index_t i) const { return diet[i]; }
+
+  bool is_dead(index_t i) const { return vitality[i] == 0; }
+
+  // Spotkania kolejnych par (pierwszy, drugi) wedlug tych samych zasad co
+  // encounter(). Pary wykonywane sa po kolei, wiec organizm moze wystapic w
+  // wielu parach. Witalnosc potomka liczona jest w chwili spotkania, ale
+  // potomstwo dopisywane jest na koniec populacji dopiero po wykonaniu
+  // wszystkich spotkan; zwracana jest jego liczba.
+  std::size_t encounter(std::span<std::pair<index_t, index_t> const> pairs) {
+    for (auto const &[first, second] : pairs)
+      if (first >= size() || second >= size())
+        throw std::out_of_range("organism index out of range");
+
+    std::vector<std::pair<index_t, uint64_t>> children;
+    for (auto const &[first, second] : pairs)
+      if (encounter_pair(first, second))
+        children.emplace_back(first, (vitality[first] + vitality[second]) / 2);
+
+    reserve(size() + children.size());
+    for (auto const &[parent, child_vitality] : children)
+      add(species[parent], child_vitality, diet[parent]);
+    return children.size();
+  }
+
+  // Jedno spotkanie bez rozgalezien zaleznych od danych: rodzaj spotkania
+  // odczytywany jest z ENCOUNTER_RULES, a nowe witalnosci liczone sa z masek.
+  // Zwraca, czy organizmy wydaja potomstwo (witalnosci sie wtedy nie zmieniaja),
+  // ale go nie dodaje. Zmienia tylko witalnosci obu organizmow, wiec mozna je
+  // wywolywac rownolegle dla rozlacznych par.
+  bool encounter_pair(index_t first, index_t second) {
+    uint64_t const v1 = vitality[first];
+    uint64_t const v2 = vitality[second];
+    encounter_rule const &rule = rule_for(diet[first], diet[second]);
+    outcome_t const outcome = species[first] == species[second]
+                                  ? rule.same_species
+                                  : rule.other_species;
+
+    bool const alive = (v1 != 0) & (v2 != 0);
+    bool const offspring = alive & (outcome == outcome_t::offspring);
+    bool const fight = alive & (outcome == outcome_t::fight);
+    bool const eats_plant = alive & (outcome == outcome_t::plant_eaten);
+    bool const one_way = alive & (outcome == outcome_t::one_way);
+
+    bool const eats1 = (fight | (one_way & rule.first_eats)) & (v1 > v2);
+    bool const eats2 = (fight | (one_way & rule.second_eats)) & (v2 > v1);
+    bool const dies1 = (fight & (v1 <= v2)) | eats2;
+    bool const dies2 = (fight & (v2 <= v1)) | eats1 | eats_plant;
+
+    vitality[first] = (v1 + ((v2 / 2) & -uint64_t(eats1)) +
+                       (v2 & -uint64_t(eats_plant))) &
+                      -uint64_t(!dies1);
+    vitality[second] = (v2 + ((v1 / 2) & -uint64_t(eats2))) & -uint64_t(!dies2);
+    return offspring;
+  }
+
+private:
+  std::vector<uint64_t> vitality;
+  std::vector<species_id_t> species;
+  std::vector<diet_t> diet;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SPECIES_REGISTRY_H
+#define SPECIES_REGISTRY_H
+
+#include <concepts>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+// Identyfikator gatunku nadany przez SpeciesRegistry. Porownanie to jedno
+// porownanie liczb, a Organism<SpeciesId<species_t>, ...> ma staly, maly
+// rozmiar niezaleznie od species_t.
+template <std::equality_comparable species_t> class SpeciesId {
+public:
+  using id_t = uint32_t;
+
+  constexpr explicit SpeciesId(id_t id) : id(id) {}
+
+  constexpr id_t get_id() const { return id; }
+
+  constexpr bool operator==(SpeciesId const &other) const = default;
+
+private:
+  id_t id;
+};
+
+template <typename species_t>
+concept hashable_species = requires(species_t const &species) {
+  { std::hash<species_t>{}(species) } -> std::convertible_to<std::size_t>;
+};
+
+// Nadaje kolejnym roznym gatunkom kolejne identyfikatory. Gatunki, ktore
+// mozna haszowac, wyszukiwane sa w tablicy haszujacej, pozostale liniowo.
+template <std::equality_comparable species_t> class SpeciesRegistry {
+public:
+  using id_t = typename SpeciesId<species_t>::id_t;
+
+  SpeciesId<species_t> intern(species_t const &species) {
+    if (auto id = find(species))
+      return *id;
+
+    if (known_species.size() > std::numeric_limits<id_t>::max())
+      throw std::length_error("too many species");
+    id_t const id = id_t(known_species.size());
+    known_species.push_back(species);
+    if constexpr (hashable_species<species_t>) {
+      try {
+        ids.emplace(known_species.back(), id);
+      } catch (...) {
+        known_species.pop_back();
+        throw;
+      }
+    }
+    return SpeciesId<species_t>(id);
+  }
+
+  std::optional<SpeciesId<species_t>> find(species_t const &species) const {
+    if constexpr (hashable_species<species_t>) {
+      auto iter = ids.find(species);
+      if (iter != ids.end())
+        return SpeciesId<species_t>(iter->second);
+    } else {
+      for (std::size_t id = 0; id < known_species.size(); ++id)
+        if (known_species[id] == species)
+          return SpeciesId<species_t>(id_t(id));
+    }
+    return std::nullopt;
+  }
+
+  // Referencja pozostaje wazna po dodaniu kolejnych gatunkow
+  species_t const &get(SpeciesId<species_t> id) const {
+    if (id.get_id() >= known_species.size())
+      throw std::out_of_range("unknown species id");
+    return known_species[id.get_id()];
+  }
+
+  std::size_t size() const { return known_species.size(); }
+
+private:
+  std::deque<species_t> known_species;
+  [[no_unique_address]] std::conditional_t<
+      hashable_species<species_t>, std::unordered_map<species_t, id_t>,
+      std::monostate>
+      ids;
+};
+
+#endif
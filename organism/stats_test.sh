@@ -0,0 +1,34 @@
+#!/bin/sh
+# Buduje i uruchamia encounter_stats_test.cc z ORGANISM_STATS i bez niego.
+# Bez ORGANISM_STATS w kodzie nie moze zostac nic z licznikow: ani ich
+# symbole, ani zmienne watkow.
+# Uzycie: ./stats_test.sh [kompilator]   (domyslnie g++)
+set -e
+
+CXX=${1:-g++}
+CXXFLAGS="-std=c++20 -pthread -Wall -Wextra"
+DIR=$(dirname "$0")
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+COUNTERS='encounter_stats_detail|thread_counters|encounter_stats\('
+
+$CXX $CXXFLAGS -O2 -DORGANISM_STATS "$DIR/encounter_stats_test.cc" -o "$OUT/stats"
+"$OUT/stats"
+# upewniamy sie, ze ponizsze sprawdzenie w ogole widzi liczniki
+$CXX $CXXFLAGS -O0 -DORGANISM_STATS -c "$DIR/encounter_stats_test.cc" -o "$OUT/stats.o"
+nm -C "$OUT/stats.o" | grep -q -E "$COUNTERS"
+
+for level in -O0 -O2; do
+    $CXX $CXXFLAGS $level "$DIR/encounter_stats_test.cc" -o "$OUT/no_stats"
+    "$OUT/no_stats"
+    if nm -C "$OUT/no_stats" | grep -E "$COUNTERS"; then
+        echo "counters left in a build without ORGANISM_STATS ($level)" >&2
+        exit 1
+    fi
+    if size -A "$OUT/no_stats" | grep -q -E '^\.tbss|^\.tdata'; then
+        echo "thread-local data in a build without ORGANISM_STATS ($level)" >&2
+        exit 1
+    fi
+done
+echo "encounter stats: ok"